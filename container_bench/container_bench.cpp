@@ -0,0 +1,346 @@
+﻿/*****************************************************************************
+BSD 3-Clause License
+
+Copyright (c) 2021, 🍀☀🌕🌥 🌊
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+#include "container.h"
+#include "values/bool_value.h"
+#include "values/container_value.h"
+#include "values/double_value.h"
+#include "values/llong_value.h"
+#include "values/string_value.h"
+
+#include "benchmark/benchmark.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace container;
+
+atomic<unsigned long long> _allocation_count{ 0 };
+
+void* operator new(size_t size)
+{
+	++_allocation_count;
+
+	void* pointer = malloc(size == 0 ? 1 : size);
+	if (pointer == nullptr)
+	{
+		throw bad_alloc();
+	}
+
+	return pointer;
+}
+
+void operator delete(void* pointer) noexcept { free(pointer); }
+
+void operator delete(void* pointer, size_t) noexcept { free(pointer); }
+
+enum class value_mix : int64_t
+{
+	numeric = 0,
+	text = 1,
+	mixed = 2
+};
+
+shared_ptr<value> make_value(const value_mix& mix, const int64_t& index)
+{
+	wstring name = L"value_" + to_wstring(index);
+
+	switch (mix)
+	{
+	case value_mix::numeric:
+		return make_shared<llong_value>(name, index * 7919);
+	case value_mix::text:
+		return make_shared<string_value>(
+			name, L"payload text for value " + to_wstring(index));
+	default:
+		break;
+	}
+
+	switch (index % 4)
+	{
+	case 0:
+		return make_shared<bool_value>(name, (index & 1) == 0);
+	case 1:
+		return make_shared<llong_value>(name, index * 7919);
+	case 2:
+		return make_shared<double_value>(name, index * 1.234567890123456789);
+	default:
+		return make_shared<string_value>(
+			name, L"payload text for value " + to_wstring(index));
+	}
+}
+
+vector<shared_ptr<value>> make_values(const value_mix& mix,
+									  const int64_t& count)
+{
+	vector<shared_ptr<value>> values;
+	values.reserve(count);
+	for (int64_t index = 0; index < count; ++index)
+	{
+		values.push_back(make_value(mix, index));
+	}
+
+	return values;
+}
+
+shared_ptr<value_container> make_container(const value_mix& mix,
+										   const int64_t& count)
+{
+	return make_shared<value_container>(L"bench_target", L"",
+										L"bench_message",
+										make_values(mix, count));
+}
+
+void report_allocations(benchmark::State& state,
+						const unsigned long long& allocations)
+{
+	state.counters["allocs/op"] = benchmark::Counter(
+		(double)allocations, benchmark::Counter::kAvgIterations);
+}
+
+void report_bytes(benchmark::State& state, const size_t& characters)
+{
+	state.SetBytesProcessed(state.iterations() * characters
+							* sizeof(wchar_t));
+}
+
+static void container_add(benchmark::State& state)
+{
+	auto mix = (value_mix)state.range(1);
+	auto values = make_values(mix, state.range(0));
+
+	unsigned long long allocations = 0;
+	for (auto _ : state)
+	{
+		auto before = _allocation_count.load();
+		value_container data;
+		for (auto& target : values)
+		{
+			data.add(target);
+		}
+		allocations += _allocation_count.load() - before;
+		benchmark::DoNotOptimize(data);
+	}
+
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+	report_allocations(state, allocations);
+}
+
+static void container_remove(benchmark::State& state)
+{
+	auto mix = (value_mix)state.range(1);
+	auto values = make_values(mix, state.range(0));
+
+	unsigned long long allocations = 0;
+	for (auto _ : state)
+	{
+		state.PauseTiming();
+		value_container data(L"bench_target", L"", L"bench_message", values);
+		state.ResumeTiming();
+
+		auto before = _allocation_count.load();
+		for (auto& target : values)
+		{
+			data.remove(target->name());
+		}
+		allocations += _allocation_count.load() - before;
+	}
+
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+	report_allocations(state, allocations);
+}
+
+static void container_lookup(benchmark::State& state)
+{
+	auto mix = (value_mix)state.range(1);
+	auto data = make_container(mix, state.range(0));
+
+	vector<wstring> names;
+	for (int64_t index = 0; index < state.range(0); ++index)
+	{
+		names.push_back(L"value_" + to_wstring(index));
+	}
+
+	unsigned long long allocations = 0;
+	for (auto _ : state)
+	{
+		auto before = _allocation_count.load();
+		for (auto& name : names)
+		{
+			benchmark::DoNotOptimize(data->get_value(name));
+		}
+		allocations += _allocation_count.load() - before;
+	}
+
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+	report_allocations(state, allocations);
+}
+
+static void container_copy(benchmark::State& state)
+{
+	auto mix = (value_mix)state.range(1);
+	auto data = make_container(mix, state.range(0));
+
+	unsigned long long allocations = 0;
+	for (auto _ : state)
+	{
+		auto before = _allocation_count.load();
+		benchmark::DoNotOptimize(data->copy(true));
+		allocations += _allocation_count.load() - before;
+	}
+
+	report_allocations(state, allocations);
+}
+
+static void container_serialize(benchmark::State& state)
+{
+	auto mix = (value_mix)state.range(1);
+	auto data = make_container(mix, state.range(0));
+	size_t characters = data->serialize().size();
+
+	unsigned long long allocations = 0;
+	for (auto _ : state)
+	{
+		auto before = _allocation_count.load();
+		benchmark::DoNotOptimize(data->serialize());
+		allocations += _allocation_count.load() - before;
+	}
+
+	report_bytes(state, characters);
+	report_allocations(state, allocations);
+}
+
+static void container_deserialize(benchmark::State& state)
+{
+	auto mix = (value_mix)state.range(1);
+	wstring serialized = make_container(mix, state.range(0))->serialize();
+
+	unsigned long long allocations = 0;
+	for (auto _ : state)
+	{
+		auto before = _allocation_count.load();
+		value_container data(serialized, false);
+		allocations += _allocation_count.load() - before;
+		benchmark::DoNotOptimize(data);
+	}
+
+	report_bytes(state, serialized.size());
+	report_allocations(state, allocations);
+}
+
+static void container_to_json(benchmark::State& state)
+{
+	auto mix = (value_mix)state.range(1);
+	auto data = make_container(mix, state.range(0));
+	size_t characters = data->to_json().size();
+
+	unsigned long long allocations = 0;
+	for (auto _ : state)
+	{
+		auto before = _allocation_count.load();
+		benchmark::DoNotOptimize(data->to_json());
+		allocations += _allocation_count.load() - before;
+	}
+
+	report_bytes(state, characters);
+	report_allocations(state, allocations);
+}
+
+static void container_to_xml(benchmark::State& state)
+{
+	auto mix = (value_mix)state.range(1);
+	auto data = make_container(mix, state.range(0));
+	size_t characters = data->to_xml().size();
+
+	unsigned long long allocations = 0;
+	for (auto _ : state)
+	{
+		auto before = _allocation_count.load();
+		benchmark::DoNotOptimize(data->to_xml());
+		allocations += _allocation_count.load() - before;
+	}
+
+	report_bytes(state, characters);
+	report_allocations(state, allocations);
+}
+
+static void container_nested(benchmark::State& state)
+{
+	// range(0) is the nesting depth, each level holds eight mixed values
+	shared_ptr<value> nested = make_shared<container_value>(
+		L"level_0", make_values(value_mix::mixed, 8));
+	for (int64_t depth = 1; depth < state.range(0); ++depth)
+	{
+		auto values = make_values(value_mix::mixed, 8);
+		values.push_back(nested);
+		nested = make_shared<container_value>(
+			L"level_" + to_wstring(depth), values);
+	}
+
+	value_container data(L"bench_target", L"", L"bench_message",
+						 vector<shared_ptr<value>>{ nested });
+	wstring serialized = data.serialize();
+
+	unsigned long long allocations = 0;
+	for (auto _ : state)
+	{
+		auto before = _allocation_count.load();
+		value_container parsed(serialized, false);
+		benchmark::DoNotOptimize(parsed.serialize());
+		allocations += _allocation_count.load() - before;
+	}
+
+	report_bytes(state, serialized.size());
+	report_allocations(state, allocations);
+}
+
+#define CONTAINER_BENCHMARK(function)                                         \
+	BENCHMARK(function)                                                       \
+		->ArgNames({ "values", "mix" })                                       \
+		->ArgsProduct({ { 8, 64, 512, 4096 }, { 0, 1, 2 } })
+
+CONTAINER_BENCHMARK(container_add);
+CONTAINER_BENCHMARK(container_remove);
+CONTAINER_BENCHMARK(container_lookup);
+CONTAINER_BENCHMARK(container_copy);
+CONTAINER_BENCHMARK(container_serialize);
+CONTAINER_BENCHMARK(container_deserialize);
+CONTAINER_BENCHMARK(container_to_json);
+CONTAINER_BENCHMARK(container_to_xml);
+BENCHMARK(container_nested)->ArgName("depth")->DenseRange(1, 9, 4);
+
+BENCHMARK_MAIN();
\ No newline at end of file
@@ -0,0 +1,120 @@
+#!/bin/bash
+# Launches one echo_server on SERVER_CORES and M echo_client processes
+# rotating over CLIENT_CORES, sweeps the options below and writes one CSV row
+# per case. Percentiles are taken over the round trips of every client.
+#
+#   CLIENT_COUNTS="1 2 4 8" PAYLOAD_SIZES="16 1024" ./echo_benchmark.sh
+#   SERVER_CORES="0-3" CLIENT_CORES="4-7" ./echo_benchmark.sh
+
+BIN_DIR=${1:-./build/release-lto/bin}
+REPORT=${REPORT:-./echo_benchmark.csv}
+ECHO_COUNT=${ECHO_COUNT:-1000}
+SERVER_PORT=${SERVER_PORT:-9876}
+CLIENT_COUNTS=${CLIENT_COUNTS:-"1 2 4"}
+PAYLOAD_SIZES=${PAYLOAD_SIZES:-"16 1024 16384"}
+WORKER_COUNTS=${WORKER_COUNTS:-"1 2 4"}
+BINARY_MODES=${BINARY_MODES:-"false true"}
+COMPRESS_MODES=${COMPRESS_MODES:-"false true"}
+ENCRYPT_MODES=${ENCRYPT_MODES:-"false true"}
+
+ECHO_SERVER="$BIN_DIR/echo_server"
+ECHO_CLIENT="$BIN_DIR/echo_client"
+
+# by default the server takes the first half of the allowed cores and the
+# clients the rest, only a single core machine shares it
+CORES=()
+for range in $(grep Cpus_allowed_list /proc/self/status | cut -f2 | tr ',' ' '); do
+    CORES+=($(seq ${range%-*} ${range#*-}))
+done
+SERVER_SHARE=$(( ${#CORES[@]} > 1 ? ${#CORES[@]} / 2 : 1 ))
+SERVER_CORES=${SERVER_CORES:-$(echo "${CORES[@]:0:$SERVER_SHARE}" | tr ' ' ',')}
+CLIENT_CORES=${CLIENT_CORES:-$(echo "${CORES[@]:$SERVER_SHARE}" | tr ' ' ',')}
+CLIENT_CORES=${CLIENT_CORES:-$SERVER_CORES}
+CLIENT_CORE_LIST=()
+for range in $(echo "$CLIENT_CORES" | tr ',' ' '); do
+    CLIENT_CORE_LIST+=($(seq ${range%-*} ${range#*-}))
+done
+TICKS=$(getconf CLK_TCK)
+WORK_DIR=$(mktemp -d)
+
+if [ ! -x "$ECHO_SERVER" ] || [ ! -x "$ECHO_CLIENT" ]; then
+    echo "echo_server and echo_client were not found on $BIN_DIR"
+    exit 1
+fi
+
+cpu_ticks() {
+    awk '{ print $14 + $15 }' "/proc/$1/stat"
+}
+
+run_case() {
+    local clients=$1 payload=$2 workers=$3 binary=$4 compress=$5 encrypt=$6
+    local modes="--binary_mode $binary --compress_mode $compress --encrypt_mode $encrypt"
+
+    taskset -c "$SERVER_CORES" "$ECHO_SERVER" --server_port "$SERVER_PORT" --logging_level 1 $modes \
+        --high_priority_count "$workers" --normal_priority_count "$workers" \
+        --low_priority_count "$workers" &
+    local server_pid=$!
+    sleep 1
+
+    local server_started=$(cpu_ticks "$server_pid")
+    local started=$(date +%s%N)
+
+    local client_pids=()
+    local failed=0
+    for ((client = 0; client < clients; client++)); do
+        local core=${CLIENT_CORE_LIST[$((client % ${#CLIENT_CORE_LIST[@]}))]}
+        taskset -c "$core" "$ECHO_CLIENT" --server_port "$SERVER_PORT" --logging_level 1 $modes \
+            --echo_count "$ECHO_COUNT" --payload_size "$payload" --latency_breakdown true \
+            --round_trip_file "$WORK_DIR/round_trip_$client.txt" > "$WORK_DIR/client_$client.csv" &
+        client_pids+=($!)
+    done
+    for ((client = 0; client < clients; client++)); do
+        # a client counts only when it exits cleanly and reports its round trips
+        if ! wait "${client_pids[$client]}" || ! grep -q "^round_trip," "$WORK_DIR/client_$client.csv"; then
+            failed=$((failed + 1))
+            rm -f "$WORK_DIR/client_$client.csv" "$WORK_DIR/round_trip_$client.txt"
+        fi
+    done
+
+    local finished=$(date +%s%N)
+    local server_used=$(( $(cpu_ticks "$server_pid") - server_started ))
+
+    kill -TERM "$server_pid"
+    wait "$server_pid"
+
+    local messages=$(((clients - failed) * ECHO_COUNT))
+    local seconds=$(awk -v n=$((finished - started)) 'BEGIN { printf "%.3f", n / 1e9 }')
+
+    # the samples of all clients are merged, so p50 and p99 are of one distribution
+    cat "$WORK_DIR"/round_trip_*.txt 2>/dev/null | sort -n | awk -v prefix="$clients,$failed,$payload,$workers,$binary,$compress,$encrypt" \
+        -v messages="$messages" -v seconds="$seconds" -v ticks="$TICKS" -v used="$server_used" '
+        { samples[count++] = $1 }
+        END {
+            if (count == 0 || messages == 0) { printf "%s,0,%s,0,,,,\n", prefix, seconds; exit }
+            printf "%s,%d,%s,%.0f,%d,%d,%d,%.2f\n", prefix, messages, seconds, messages / seconds,
+                samples[int(0.5 * (count - 1))], samples[int(0.99 * (count - 1))], samples[count - 1],
+                used * 1e6 / ticks / messages
+        }' >> "$REPORT"
+
+    rm -f "$WORK_DIR"/client_*.csv "$WORK_DIR"/round_trip_*.txt
+}
+
+echo "clients,failed_clients,payload_bytes,workers,binary_mode,compress_mode,encrypt_mode,messages,seconds,messages_per_sec,p50_ns,p99_ns,max_ns,server_cpu_us_per_message" > "$REPORT"
+
+for clients in $CLIENT_COUNTS; do
+    for payload in $PAYLOAD_SIZES; do
+        for workers in $WORKER_COUNTS; do
+            for binary in $BINARY_MODES; do
+                for compress in $COMPRESS_MODES; do
+                    for encrypt in $ENCRYPT_MODES; do
+                        run_case "$clients" "$payload" "$workers" "$binary" "$compress" "$encrypt"
+                    done
+                done
+            done
+        done
+    done
+done
+
+rm -rf "$WORK_DIR"
+
+cat "$REPORT"
@@ -30,9 +30,20 @@ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 *****************************************************************************/
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
 #include <future>
 #include <iostream>
+#include <limits.h>
 #include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
 #include <stdlib.h>
 #include <string>
 
@@ -45,12 +56,20 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "messaging_client.h"
 
 #include "container.h"
+#include "values/bool_value.h"
 #include "values/container_value.h"
+#include "values/llong_value.h"
 #include "values/string_value.h"
 
 #include "fmt/format.h"
 #include "fmt/xchar.h"
 
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
 constexpr auto PROGRAM_NAME = L"echo_client";
 
 using namespace std;
@@ -80,6 +99,21 @@ unsigned short high_priority_count = 1;
 unsigned short normal_priority_count = 2;
 unsigned short low_priority_count = 3;
 
+struct server_node
+{
+	wstring ip;
+	unsigned short port;
+	double weight;
+};
+
+vector<server_node> server_nodes;
+wstring routing_key = PROGRAM_NAME;
+wstring trace_file = L"";
+unsigned int echo_count = 1;
+unsigned int payload_size = 0;
+bool latency_breakdown = false;
+wstring round_trip_file = L"";
+
 shared_ptr<thread_pool> _thread_pool = nullptr;
 
 map<wstring, function<void(const vector<uint8_t>&)>> _registered_messages;
@@ -88,9 +122,34 @@ optional<promise<bool>> _promise_status;
 future<bool> _future_status;
 shared_ptr<messaging_client> _client = nullptr;
 
+struct trace_span
+{
+	wstring name;
+	wstring trace_id;
+	wstring span_id;
+	long long start;
+	long long duration;
+};
+
+mutex _trace_mutex;
+map<wstring, pair<wstring, chrono::steady_clock::time_point>> _open_traces;
+vector<trace_span> _trace_spans;
+
+atomic<unsigned int> _echo_received{ 0 };
+atomic<long long> _binary_sent_time{ 0 };
+
+mutex _latency_mutex;
+vector<pair<wstring, vector<long long>>> _latency_stages
+	= { { L"network_out", {} }, { L"server_queue", {} },
+		{ L"server_dispatch", {} }, { L"server_handling", {} },
+		{ L"network_back", {} }, { L"round_trip", {} } };
+
 bool parse_arguments(argument_manager& arguments);
 void display_help(void);
 
+vector<server_node> parse_server_list(const wstring& server_list);
+uint64_t routing_hash(const wstring& key, const server_node& node);
+void select_server(void);
 void create_client(void);
 void create_thread_pool(void);
 void send_echo_test_message(const wstring& target_id,
@@ -105,6 +164,14 @@ void received_binary_message(const wstring& source_id,
 							 const wstring& target_sub_id,
 							 const vector<uint8_t>& data);
 void received_echo_test(const vector<uint8_t>& data);
+bool continue_echo_test(const wstring& target_id,
+						const wstring& target_sub_id);
+void record_latency(shared_ptr<container::value_container> container);
+void write_latency_report(void);
+long long wall_clock_ns(void);
+wstring create_trace_id(const size_t& words);
+bool is_hex_id(const wstring& identifier, const size_t& length);
+void export_trace_spans(void);
 
 int main(int argc, char* argv[])
 {
@@ -126,12 +193,14 @@ int main(int argc, char* argv[])
 
 	create_thread_pool();
 
+	select_server();
+
 	create_client();
 
 	_promise_status = { promise<bool>() };
 	_future_status = _promise_status.value().get_future();
 
-	_future_status.wait();
+	bool succeeded = _future_status.get();
 	_promise_status.reset();
 
 	_thread_pool->stop();
@@ -140,9 +209,12 @@ int main(int argc, char* argv[])
 	_client->stop();
 	_client.reset();
 
+	export_trace_spans();
+	write_latency_report();
+
 	logger::handle().stop();
 
-	return 0;
+	return succeeded ? 0 : 1;
 }
 
 bool parse_arguments(argument_manager& arguments)
@@ -197,6 +269,48 @@ bool parse_arguments(argument_manager& arguments)
 		server_port = *ushort_target;
 	}
 
+	string_target = arguments.to_string(L"--server_list");
+	if (string_target != nullopt)
+	{
+		server_nodes = parse_server_list(*string_target);
+	}
+
+	string_target = arguments.to_string(L"--routing_key");
+	if (string_target != nullopt && !string_target->empty())
+	{
+		routing_key = *string_target;
+	}
+
+	string_target = arguments.to_string(L"--trace_file");
+	if (string_target != nullopt)
+	{
+		trace_file = *string_target;
+	}
+
+	auto int_target = arguments.to_int(L"--echo_count");
+	if (int_target != nullopt && *int_target > 0)
+	{
+		echo_count = (unsigned int)*int_target;
+	}
+
+	int_target = arguments.to_int(L"--payload_size");
+	if (int_target != nullopt && *int_target >= 0)
+	{
+		payload_size = (unsigned int)*int_target;
+	}
+
+	bool_target = arguments.to_bool(L"--latency_breakdown");
+	if (bool_target != nullopt)
+	{
+		latency_breakdown = *bool_target;
+	}
+
+	string_target = arguments.to_string(L"--round_trip_file");
+	if (string_target != nullopt)
+	{
+		round_trip_file = *string_target;
+	}
+
 	ushort_target = arguments.to_ushort(L"--high_priority_count");
 	if (ushort_target != nullopt)
 	{
@@ -215,7 +329,7 @@ bool parse_arguments(argument_manager& arguments)
 		low_priority_count = *ushort_target;
 	}
 
-	auto int_target = arguments.to_int(L"--logging_level");
+	int_target = arguments.to_int(L"--logging_level");
 	if (int_target != nullopt)
 	{
 		log_level = (logging_level)*int_target;
@@ -245,6 +359,48 @@ bool parse_arguments(argument_manager& arguments)
 void display_help(void)
 {
 	wcout << L"pathfinder connector options:" << endl << endl;
+	wcout << L"--server_list [value]" << endl;
+	wcout << L"\tIf you want to pick a server by the routing key must be "
+			 L"appended\n\t'--server_list ip:port[:weight],ip:port[:weight]'."
+		  << endl
+		  << endl;
+	wcout << L"--routing_key [value]" << endl;
+	wcout << L"\tIf you want to change the key mapped onto '--server_list' "
+			 L"must be appended\n\t'--routing_key [target id]'.\n\tInitialize "
+			 L"value is --routing_key echo_client."
+		  << endl
+		  << endl;
+	wcout << L"--trace_file [value]" << endl;
+	wcout << L"\tIf you want to send a sampled trace context and record the "
+			 L"round trip in Chrome trace\n\tformat must be appended "
+			 L"'--trace_file [path]'."
+		  << endl
+		  << endl;
+	wcout << L"--echo_count [value]" << endl;
+	wcout << L"\tIf you want to send echo messages one after another must be "
+			 L"appended\n\t'--echo_count [count]'.\n\tInitialize value is "
+			 L"--echo_count 1."
+		  << endl
+		  << endl;
+	wcout << L"--latency_breakdown [value]" << endl;
+	wcout << L"\tIf you want to report network out, server queueing, handling "
+			 L"and network back latency\n\tmust be appended "
+			 L"'--latency_breakdown true'. One way stages assume synchronized "
+			 L"clocks\n\tand binary mode reports round_trip only."
+		  << endl
+		  << endl;
+	wcout << L"--round_trip_file [value]" << endl;
+	wcout << L"\tIf you want to write every round_trip sample of "
+			 L"'--latency_breakdown true' in\n\tnanoseconds, one per line, "
+			 L"must be appended '--round_trip_file [path]'."
+		  << endl
+		  << endl;
+	wcout << L"--payload_size [value]" << endl;
+	wcout << L"\tIf you want to attach a payload to each echo message must be "
+			 L"appended\n\t'--payload_size [bytes]'.\n\tInitialize value is "
+			 L"--payload_size 0."
+		  << endl
+		  << endl;
 	wcout << L"--write_console [value] " << endl;
 	wcout << L"\tThe write_console_mode on/off. If you want to display log on "
 			 L"console must be appended '--write_console true'.\n\tInitialize "
@@ -257,6 +413,100 @@ void display_help(void)
 		  << endl;
 }
 
+vector<server_node> parse_server_list(const wstring& server_list)
+{
+	vector<server_node> nodes;
+
+	wstring entry;
+	wstringstream entries(server_list);
+	while (getline(entries, entry, L','))
+	{
+		vector<wstring> fields;
+		wstring field;
+		wstringstream entry_stream(entry);
+		while (getline(entry_stream, field, L':'))
+		{
+			fields.push_back(field);
+		}
+
+		if (fields.size() < 2 || fields.size() > 3 || fields[0].empty())
+		{
+			continue;
+		}
+
+		unsigned long port = wcstoul(fields[1].c_str(), nullptr, 10);
+		double weight = (fields.size() == 3)
+							? wcstod(fields[2].c_str(), nullptr)
+							: 1.0;
+		if (port == 0 || port > USHRT_MAX || !(weight > 0.0))
+		{
+			continue;
+		}
+
+		nodes.push_back({ fields[0], (unsigned short)port, weight });
+	}
+
+	return nodes;
+}
+
+uint64_t routing_hash(const wstring& key, const server_node& node)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	auto mix = [&hash](const wstring& source)
+	{
+		for (auto& character : source)
+		{
+			hash ^= (uint64_t)character;
+			hash *= 1099511628211ULL;
+		}
+		hash ^= 0xff;
+		hash *= 1099511628211ULL;
+	};
+
+	mix(key);
+	mix(node.ip);
+	mix(to_wstring(node.port));
+
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdULL;
+	hash ^= hash >> 33;
+	hash *= 0xc4ceb9fe1a85ec53ULL;
+	hash ^= hash >> 33;
+
+	return hash;
+}
+
+void select_server(void)
+{
+	if (server_nodes.empty())
+	{
+		return;
+	}
+
+	// weighted rendezvous hashing: only keys owned by a changed node move
+	const server_node* selected = nullptr;
+	double best_score = 0.0;
+	for (auto& node : server_nodes)
+	{
+		uint64_t hash = routing_hash(routing_key, node);
+		double unit = ((hash >> 11) + 0.5) / 9007199254740992.0;
+		double score = -node.weight / log(unit);
+		if (selected == nullptr || score > best_score)
+		{
+			selected = &node;
+			best_score = score;
+		}
+	}
+
+	server_ip = selected->ip;
+	server_port = selected->port;
+
+	logger::handle().write(
+		logging_level::information,
+		fmt::format(L"routing key {} is mapped to {}:{}", routing_key,
+					server_ip, server_port));
+}
+
 void create_client(void)
 {
 	if (_client != nullptr)
@@ -315,16 +565,46 @@ void send_echo_test_message(const wstring& target_id,
 {
 	if (binary_mode)
 	{
-		_client->send_binary(target_id, target_sub_id,
-							 converter::to_array(L"echo_test"));
+		static const auto echo_data
+			= payload_size > 0 ? vector<uint8_t>(payload_size, 'e')
+							   : converter::to_array(L"echo_test");
+
+		if (latency_breakdown)
+		{
+			_binary_sent_time = wall_clock_ns();
+		}
+		_client->send_binary(target_id, target_sub_id, echo_data);
 
 		return;
 	}
 
+	vector<shared_ptr<value>> values;
+	if (payload_size > 0)
+	{
+		static const wstring payload(payload_size, L'e');
+
+		values.push_back(make_shared<string_value>(L"payload", payload));
+	}
+	if (!trace_file.empty())
+	{
+		wstring trace_id = create_trace_id(2);
+		wstring span_id = create_trace_id(1);
+		values.push_back(make_shared<string_value>(L"trace_id", trace_id));
+		values.push_back(make_shared<string_value>(L"span_id", span_id));
+		values.push_back(make_shared<bool_value>(L"trace_sampled", true));
+
+		scoped_lock<mutex> guard(_trace_mutex);
+		_open_traces.insert(
+			{ trace_id, { span_id, chrono::steady_clock::now() } });
+	}
+
 	shared_ptr<container::value_container> container
 		= make_shared<container::value_container>(target_id, target_sub_id,
-												  L"echo_test",
-												  vector<shared_ptr<value>>{});
+												  L"echo_test", values);
+	if (latency_breakdown)
+	{
+		container->add(llong_value(L"client_send_time", wall_clock_ns()));
+	}
 
 	_client->send(container);
 }
@@ -362,6 +642,12 @@ void received_message(shared_ptr<container::value_container> container)
 	auto message_type = _registered_messages.find(container->message_type());
 	if (message_type != _registered_messages.end())
 	{
+		if (latency_breakdown)
+		{
+			container->add(
+				llong_value(L"client_receive_time", wall_clock_ns()));
+		}
+
 		if (_thread_pool)
 		{
 			_thread_pool->push(make_shared<job>(
@@ -372,9 +658,13 @@ void received_message(shared_ptr<container::value_container> container)
 		return;
 	}
 
-	logger::handle().write(
-		logging_level::sequence,
-		fmt::format(L"unknown message: {}", container->serialize()));
+	// serialize() is only paid for when the record is written
+	if (log_level >= logging_level::sequence)
+	{
+		logger::handle().write(
+			logging_level::sequence,
+			fmt::format(L"unknown message: {}", container->serialize()));
+	}
 
 	if (_promise_status.has_value())
 	{
@@ -398,9 +688,24 @@ void received_binary_message(const wstring& source_id,
 		return;
 	}
 
-	logger::handle().write(
-		logging_level::sequence,
-		fmt::format(L"received message: {}", converter::to_wstring(data)));
+	if (log_level >= logging_level::sequence)
+	{
+		logger::handle().write(
+			logging_level::sequence,
+			fmt::format(L"received message: {}", converter::to_wstring(data)));
+	}
+
+	if (latency_breakdown)
+	{
+		scoped_lock<mutex> guard(_latency_mutex);
+		_latency_stages.back().second.push_back(wall_clock_ns()
+												- _binary_sent_time);
+	}
+
+	if (continue_echo_test(source_id, source_sub_id))
+	{
+		return;
+	}
 
 	if (_promise_status.has_value())
 	{
@@ -432,12 +737,195 @@ void received_echo_test(const vector<uint8_t>& data)
 		return;
 	}
 
+	wstring trace_id;
+	auto target = container->get_value(L"trace_id");
+	if (target != nullptr && !target->is_null()
+		&& is_hex_id(target->to_string(), 32))
+	{
+		trace_id = target->to_string();
+
+		scoped_lock<mutex> guard(_trace_mutex);
+		auto opened = _open_traces.find(trace_id);
+		if (opened != _open_traces.end())
+		{
+			auto& started = opened->second.second;
+			_trace_spans.push_back(
+				{ L"echo_round_trip", trace_id, opened->second.first,
+				  chrono::duration_cast<chrono::microseconds>(
+					  started.time_since_epoch())
+					  .count(),
+				  chrono::duration_cast<chrono::microseconds>(
+					  chrono::steady_clock::now() - started)
+					  .count() });
+			_open_traces.erase(opened);
+		}
+	}
+
 	logger::handle().write(
 		logging_level::sequence,
-		fmt::format(L"received message: {}", container->message_type()));
+		fmt::format(L"{}received message: {}",
+					trace_id.empty() ? L""
+									 : fmt::format(L"[trace {}] ", trace_id),
+					container->message_type()));
+
+	if (latency_breakdown)
+	{
+		record_latency(container);
+	}
+
+	if (continue_echo_test(container->source_id(),
+						   container->source_sub_id()))
+	{
+		return;
+	}
 
 	if (_promise_status.has_value())
 	{
 		_promise_status.value().set_value(true);
 	}
+}
+
+bool continue_echo_test(const wstring& target_id,
+						const wstring& target_sub_id)
+{
+	if (++_echo_received >= echo_count)
+	{
+		return false;
+	}
+
+	send_echo_test_message(target_id, target_sub_id);
+
+	return true;
+}
+
+void record_latency(shared_ptr<container::value_container> container)
+{
+	vector<long long> stamps;
+	for (auto& name :
+		 { L"client_send_time", L"server_receive_time", L"server_dequeue_time",
+		   L"server_handler_time", L"server_send_time",
+		   L"client_receive_time" })
+	{
+		auto target = container->get_value(name);
+		if (target == nullptr || target->is_null())
+		{
+			return;
+		}
+
+		stamps.push_back(target->to_llong());
+	}
+
+	scoped_lock<mutex> guard(_latency_mutex);
+	for (size_t stage = 0; stage < stamps.size() - 1; ++stage)
+	{
+		_latency_stages[stage].second.push_back(stamps[stage + 1]
+												- stamps[stage]);
+	}
+	_latency_stages.back().second.push_back(stamps.back() - stamps.front());
+}
+
+void write_latency_report(void)
+{
+	if (!latency_breakdown)
+	{
+		return;
+	}
+
+	scoped_lock<mutex> guard(_latency_mutex);
+
+	wcout << L"stage,samples,p50_ns,p90_ns,p99_ns,max_ns" << endl;
+	for (auto& stage : _latency_stages)
+	{
+		auto& samples = stage.second;
+		if (samples.empty())
+		{
+			continue;
+		}
+
+		sort(samples.begin(), samples.end());
+
+		auto percentile = [&samples](const double& rank)
+		{ return samples[(size_t)(rank * (samples.size() - 1))]; };
+
+		wcout << fmt::format(L"{},{},{},{},{},{}", stage.first,
+							 samples.size(), percentile(0.5), percentile(0.9),
+							 percentile(0.99), samples.back())
+			  << endl;
+	}
+
+	// raw samples let several clients be merged into one distribution
+	if (round_trip_file.empty())
+	{
+		return;
+	}
+
+	filesystem::path target(round_trip_file);
+	wofstream stream(target);
+	for (auto& sample : _latency_stages.back().second)
+	{
+		stream << sample << L"\n";
+	}
+}
+
+long long wall_clock_ns(void)
+{
+	return chrono::duration_cast<chrono::nanoseconds>(
+			   chrono::system_clock::now().time_since_epoch())
+		.count();
+}
+
+wstring create_trace_id(const size_t& words)
+{
+	static thread_local mt19937_64 generator(random_device{}());
+
+	wstring identifier;
+	for (size_t index = 0; index < words; ++index)
+	{
+		identifier += fmt::format(L"{:016x}", generator());
+	}
+
+	return identifier;
+}
+
+bool is_hex_id(const wstring& identifier, const size_t& length)
+{
+	return identifier.size() == length
+		   && all_of(identifier.begin(), identifier.end(),
+					 [](const wchar_t& character)
+					 {
+						 return (character >= L'0' && character <= L'9')
+								|| (character >= L'a' && character <= L'f')
+								|| (character >= L'A' && character <= L'F');
+					 });
+}
+
+void export_trace_spans(void)
+{
+	if (trace_file.empty())
+	{
+		return;
+	}
+
+#ifdef _WIN32
+	int process_id = _getpid();
+#else
+	int process_id = getpid();
+#endif
+
+	scoped_lock<mutex> guard(_trace_mutex);
+
+	filesystem::path target(trace_file);
+	wofstream stream(target);
+	stream << L"{\"traceEvents\":[";
+	for (size_t index = 0; index < _trace_spans.size(); ++index)
+	{
+		auto& span = _trace_spans[index];
+		stream << fmt::format(
+			L"{}{{\"name\":\"{}\",\"cat\":\"{}\",\"ph\":\"X\","
+			L"\"ts\":{},\"dur\":{},\"pid\":{},\"tid\":0,"
+			L"\"args\":{{\"trace_id\":\"{}\",\"span_id\":\"{}\"}}}}",
+			index == 0 ? L"" : L",", span.name, PROGRAM_NAME, span.start,
+			span.duration, process_id, span.trace_id, span.span_id);
+	}
+	stream << L"]}" << endl;
 }
\ No newline at end of file
@@ -30,10 +30,25 @@ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 *****************************************************************************/
 
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
 #include <memory>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <set>
+#include <sstream>
 #include <stdlib.h>
 #include <string>
+#include <thread>
+#include <tuple>
 
 #include "argument_parser.h"
 #include "converting.h"
@@ -45,78 +60,379 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "thread_pool.h"
 
 #include "container.h"
+#include "values/bool_value.h"
 #include "values/container_value.h"
+#include "values/llong_value.h"
 #include "values/string_value.h"
+#include "values/ullong_value.h"
 
 #include "fmt/format.h"
 #include "fmt/xchar.h"
 
 #include <signal.h>
 
+#ifdef _WIN32
+#include <process.h>
+#include <windows.h>
+#else
+#include <errno.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
 constexpr auto PROGRAM_NAME = L"echo_server";
 
 using namespace std;
 using namespace logging;
 using namespace threads;
 using namespace network;
+using namespace container;
 using namespace converting;
 using namespace file_handler;
 using namespace argument_parser;
 
 bool encrypt_mode = false;
-bool compress_mode = false;
+atomic<bool> compress_mode{ false };
 bool binary_mode = false;
+bool admin_mode = false;
 unsigned short compress_block_size = 1024;
 #ifdef _DEBUG
-logging_level log_level = logging_level::parameter;
+atomic<logging_level> log_level{ logging_level::parameter };
 logging_styles logging_style = logging_styles::console_only;
 #else
-logging_level log_level = logging_level::information;
+atomic<logging_level> log_level{ logging_level::information };
 logging_styles logging_style = logging_styles::file_only;
 #endif
-wstring connection_key = L"echo_network";
+constexpr auto DEFAULT_CONNECTION_KEY = L"echo_network";
+wstring connection_key = DEFAULT_CONNECTION_KEY;
 unsigned short server_port = 9876;
 unsigned short high_priority_count = 4;
 unsigned short normal_priority_count = 4;
 unsigned short low_priority_count = 4;
 size_t session_limit_count = 0;
+unsigned short shutdown_timeout = 5000;
+string config_file = "";
+wstring trace_file = L"";
+wstring profile_file = L"";
+unsigned short profile_frequency = 99;
+wstring soak_file = L"";
+unsigned short soak_interval = 60;
+
+const vector<string> CONFIGURABLE_OPTIONS = { "--encrypt_mode",
+											  "--compress_mode",
+											  "--binary_mode",
+											  "--compress_block_size",
+											  "--connection_key",
+											  "--server_port",
+											  "--high_priority_count",
+											  "--normal_priority_count",
+											  "--low_priority_count",
+											  "--logging_level",
+											  "--session_limit_count",
+											  "--shutdown_timeout",
+											  "--admin_mode",
+											  "--trace_file",
+											  "--profile_file",
+											  "--profile_frequency",
+											  "--soak_file",
+											  "--soak_interval",
+											  "--write_console_only",
+											  "--write_console" };
 
 shared_ptr<thread_pool> _thread_pool = nullptr;
 
-map<wstring, function<void(const vector<uint8_t>&)>> _registered_messages;
+// admin_control and config reloads may grow each priority up to this many
+// times its startup worker count
+constexpr unsigned short MAX_WORKER_SCALE = 4;
+
+mutex _worker_mutex;
+map<priorities, long long> _worker_limits;
+
+map<wstring, function<void(shared_ptr<container::value_container>)>>
+	_registered_messages;
+
+struct pending_message
+{
+	shared_ptr<container::value_container> container;
+	chrono::steady_clock::time_point received;
+	long long received_time;
+};
+
+mutex _pending_mutex;
+vector<pending_message> _pending_messages;
+
+struct trace_context
+{
+	wstring trace_id;
+	wstring span_id;
+	bool sampled = false;
+};
+
+struct trace_span
+{
+	wstring name;
+	wstring trace_id;
+	wstring parent_id;
+	long long start;
+	long long duration;
+	size_t thread_id;
+};
+
+constexpr size_t MAX_TRACE_SPANS = 1 << 20;
+
+mutex _trace_mutex;
+vector<trace_span> _trace_spans;
+thread_local trace_context _current_trace;
+
+struct latency_context
+{
+	long long client_send = 0;
+	long long received = 0;
+	long long dequeued = 0;
+	long long handler_started = 0;
+};
+
+thread_local latency_context _current_latency;
+
+enum class subsystem_tags : size_t
+{
+	untagged,
+	network_receive,
+	deserialize,
+	queue_drain,
+	send,
+	handler
+};
+
+constexpr size_t MAX_SUBSYSTEM_TAGS = 32;
+
+vector<wstring> _subsystem_names = { L"untagged", L"network_receive",
+									 L"deserialize", L"queue_drain",
+									 L"send" };
+map<wstring, size_t> _handler_tags;
+// volatile sig_atomic_t because profile_callback reads it from SIGPROF
+thread_local volatile sig_atomic_t _subsystem_tag
+	= (sig_atomic_t)subsystem_tags::untagged;
+atomic<unsigned long long> _profile_samples[MAX_SUBSYSTEM_TAGS];
+
+class subsystem_scope
+{
+public:
+	subsystem_scope(const size_t& tag) : _previous(_subsystem_tag)
+	{
+		_subsystem_tag = (sig_atomic_t)tag;
+	}
+	subsystem_scope(const subsystem_tags& tag) : subsystem_scope((size_t)tag)
+	{
+	}
+	~subsystem_scope(void) { _subsystem_tag = _previous; }
+
+private:
+	sig_atomic_t _previous;
+};
+
+#ifdef ALLOCATION_TRACKING
+struct allocation_counter
+{
+	atomic<unsigned long long> count;
+	atomic<unsigned long long> bytes;
+	atomic<long long> live_bytes;
+	atomic<long long> peak_bytes;
+};
+
+struct allocation_snapshot
+{
+	wstring name;
+	unsigned long long count;
+	unsigned long long bytes;
+	long long live_bytes;
+	long long peak_bytes;
+};
+
+// keeps the returned pointer aligned for max_align_t
+constexpr size_t ALLOCATION_HEADER_SIZE = 16;
+
+allocation_counter _allocation_counters[MAX_SUBSYSTEM_TAGS];
+
+void* operator new(size_t size)
+{
+	size_t tag = (size_t)_subsystem_tag;
+	auto block = static_cast<size_t*>(malloc(size + ALLOCATION_HEADER_SIZE));
+	if (block == nullptr)
+	{
+		throw bad_alloc();
+	}
+	block[0] = size;
+	block[1] = tag;
+
+	auto& counter = _allocation_counters[tag];
+	counter.count.fetch_add(1, memory_order_relaxed);
+	counter.bytes.fetch_add(size, memory_order_relaxed);
+	long long live
+		= counter.live_bytes.fetch_add(size, memory_order_relaxed) + size;
+	long long peak = counter.peak_bytes.load(memory_order_relaxed);
+	while (live > peak
+		   && !counter.peak_bytes.compare_exchange_weak(
+			   peak, live, memory_order_relaxed))
+	{
+	}
+
+	return reinterpret_cast<uint8_t*>(block) + ALLOCATION_HEADER_SIZE;
+}
+
+void operator delete(void* pointer) noexcept
+{
+	if (pointer == nullptr)
+	{
+		return;
+	}
+
+	auto block = reinterpret_cast<size_t*>(static_cast<uint8_t*>(pointer)
+										   - ALLOCATION_HEADER_SIZE);
+	_allocation_counters[block[1]].live_bytes.fetch_sub(
+		block[0], memory_order_relaxed);
+
+	free(block);
+}
+
+void operator delete(void* pointer, size_t) noexcept
+{
+	operator delete(pointer);
+}
+#endif
+
+atomic<unsigned long long> _session_count{ 0 };
+atomic<unsigned long long> _received_count{ 0 };
+atomic<size_t> _in_flight_count{ 0 };
+atomic<bool> _accepting{ true };
 
 shared_ptr<messaging_server> _server = nullptr;
 
+#ifdef _WIN32
+atomic<bool> _shutdown_requested{ false };
+HANDLE _shutdown_event = nullptr;
+#else
+int _shutdown_pipe[2] = { -1, -1 };
+#endif
+thread _shutdown_thread;
+
+bool _config_watching = false;
+mutex _config_mutex;
+condition_variable _config_condition;
+thread _config_thread;
+set<string> _pinned_options;
+
+// consecutive growing samples before memory growth is flagged
+constexpr size_t SOAK_DRIFT_WINDOW = 6;
+// handler latencies go to log-linear buckets, 8 per power of two, so a
+// percentile is off by at most 1/8 whatever the message rate
+constexpr size_t SOAK_BUCKET_BITS = 3;
+constexpr size_t SOAK_BUCKET_COUNT = 40 << SOAK_BUCKET_BITS;
+
+struct soak_sample
+{
+	long long elapsed;
+	long long rss_bytes;
+	long long live_bytes;
+	unsigned long long sessions;
+	size_t queue_depth;
+	unsigned long long received;
+	long long p50_ns;
+	long long p99_ns;
+};
+
+bool _soak_running = false;
+mutex _soak_mutex;
+condition_variable _soak_condition;
+thread _soak_thread;
+atomic<unsigned long long> _soak_histogram[SOAK_BUCKET_COUNT];
+
+vector<string> merge_arguments(int argc, char* argv[]);
+map<string, string> load_config_file(const string& path);
+void watch_config_file(void);
+optional<long long> parse_integer(const string& value);
+optional<bool> parse_boolean(const string& value);
+bool is_logging_level(const long long& level);
+void run_soak_sampler(void);
+soak_sample take_soak_sample(const chrono::steady_clock::time_point& started);
+size_t latency_bucket(const long long& latency);
+long long bucket_upper_bound(const size_t& bucket);
+wstring detect_drift(const vector<soak_sample>& samples);
+long long resident_bytes(void);
 bool parse_arguments(argument_manager& arguments);
 void display_help(void);
 
 void create_server(void);
 void create_thread_pool(void);
+shared_ptr<thread_worker> create_worker(const priorities& priority);
+bool grow_workers(const priorities& priority,
+				  const long long& requested,
+				  unsigned short& worker_count);
 void connection(const wstring& target_id,
 				const wstring& target_sub_id,
 				const bool& condition);
 void received_message(shared_ptr<container::value_container> container);
+void process_pending_messages(void);
 void received_binary_message(const wstring& source_id,
 							 const wstring& source_sub_id,
 							 const wstring& target_id,
 							 const wstring& target_sub_id,
 							 const vector<uint8_t>& data);
-void received_echo_test(const vector<uint8_t>& data);
+void received_echo_test(shared_ptr<container::value_container> container);
+void received_admin_control(
+	shared_ptr<container::value_container> container);
+trace_context read_trace_context(
+	shared_ptr<container::value_container> container);
+void write_trace_context(shared_ptr<container::value_container> container);
+void write_latency_context(shared_ptr<container::value_container> container);
+long long wall_clock_ns(void);
+wstring trace_prefix(void);
+bool is_hex_id(const wstring& identifier, const size_t& length);
+void record_span(const wstring& name,
+				 const chrono::steady_clock::time_point& start,
+				 const chrono::steady_clock::time_point& end);
+void export_trace_spans(void);
+void register_subsystem_tags(void);
+void start_profiler(void);
+void stop_profiler(void);
+void profile_callback(int signum);
+#ifdef ALLOCATION_TRACKING
+vector<allocation_snapshot> take_allocation_snapshot(void);
+void write_allocation_snapshot(void);
+#endif
+void wait_shutdown_signal(void);
+void shutdown_server(void);
 void signal_callback(int signum);
 
 int main(int argc, char* argv[])
 {
-	argument_manager arguments(argc, argv);
+	vector<string> merged = merge_arguments(argc, argv);
+	vector<char*> merged_argv;
+	for (auto& argument : merged)
+	{
+		merged_argv.push_back(argument.data());
+	}
+
+	argument_manager arguments((int)merged_argv.size(), merged_argv.data());
 	if (!parse_arguments(arguments))
 	{
 		return 0;
 	}
 
+#ifdef _WIN32
+	_shutdown_event = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+	if (_shutdown_event == nullptr)
+	{
+		return 0;
+	}
+#else
+	if (pipe(_shutdown_pipe) != 0)
+	{
+		return 0;
+	}
+#endif
+
 	signal(SIGINT, signal_callback);
-	signal(SIGILL, signal_callback);
-	signal(SIGABRT, signal_callback);
-	signal(SIGFPE, signal_callback);
-	signal(SIGSEGV, signal_callback);
 	signal(SIGTERM, signal_callback);
 
 	logger::handle().set_write_console(logging_style);
@@ -128,147 +444,690 @@ int main(int argc, char* argv[])
 #endif
 
 	_registered_messages.insert({ L"echo_test", received_echo_test });
+	if (admin_mode && connection_key == DEFAULT_CONNECTION_KEY)
+	{
+		// the default key is public, so anyone could send admin_control
+		admin_mode = false;
+
+		logger::handle().write(
+			logging_level::error,
+			L"admin_mode is refused while connection_key is the default, "
+			L"set --connection_key to enable it");
+	}
+	if (admin_mode)
+	{
+		_registered_messages.insert(
+			{ L"admin_control", received_admin_control });
+
+		logger::handle().write(
+			logging_level::error,
+			L"admin_mode is on: any peer with the connection key can change "
+			L"logging, compression and workers, so keep the server port "
+			L"local");
+	}
+
+	register_subsystem_tags();
+	start_profiler();
 
 	create_thread_pool();
 
 	create_server();
 
+	_shutdown_thread = thread(&wait_shutdown_signal);
+
+	if (!config_file.empty())
+	{
+		_config_watching = true;
+		_config_thread = thread(&watch_config_file);
+	}
+
+	if (!soak_file.empty())
+	{
+		_soak_running = true;
+		_soak_thread = thread(&run_soak_sampler);
+	}
+
 	_server->wait_stop();
 
+#ifdef _WIN32
+	SetEvent(_shutdown_event);
+	_shutdown_thread.join();
+	CloseHandle(_shutdown_event);
+#else
+	close(_shutdown_pipe[1]);
+	_shutdown_thread.join();
+	close(_shutdown_pipe[0]);
+#endif
+
+	if (_config_thread.joinable())
+	{
+		{
+			scoped_lock<mutex> guard(_config_mutex);
+			_config_watching = false;
+		}
+		_config_condition.notify_one();
+		_config_thread.join();
+	}
+
+	if (_soak_thread.joinable())
+	{
+		{
+			scoped_lock<mutex> guard(_soak_mutex);
+			_soak_running = false;
+		}
+		_soak_condition.notify_one();
+		_soak_thread.join();
+	}
+
 	_thread_pool->stop();
 
+	stop_profiler();
+	export_trace_spans();
+#ifdef ALLOCATION_TRACKING
+	write_allocation_snapshot();
+#endif
+
 	logger::handle().stop();
 
 	return 0;
 }
 
-bool parse_arguments(argument_manager& arguments)
+vector<string> merge_arguments(int argc, char* argv[])
 {
-	wstring temp;
-
-	auto string_target = arguments.to_string(L"--help");
-	if (string_target != nullopt)
+	vector<string> arguments(argv, argv + argc);
+	auto contains = [&arguments](const string& option)
 	{
-		display_help();
-
-		return false;
+		return find(arguments.begin(), arguments.end(), option)
+			   != arguments.end();
+	};
+
+	auto config_target
+		= find(arguments.begin(), arguments.end(), "--config_file");
+	if (config_target != arguments.end()
+		&& next(config_target) != arguments.end())
+	{
+		config_file = *next(config_target);
 	}
 
-	auto bool_target = arguments.to_bool(L"--encrypt_mode");
-	if (bool_target != nullopt)
+	// command line > ECHO_SERVER_* environment > config file
+	vector<pair<string, string>> overlays;
+	for (auto& option : CONFIGURABLE_OPTIONS)
 	{
-		encrypt_mode = *bool_target;
+		if (contains(option))
+		{
+			_pinned_options.insert(option);
+		}
+
+		string environment_name = "ECHO_SERVER_" + option.substr(2);
+		transform(environment_name.begin(), environment_name.end(),
+				  environment_name.begin(), ::toupper);
+
+		const char* environment_value = getenv(environment_name.c_str());
+		if (environment_value != nullptr)
+		{
+			overlays.push_back({ option, environment_value });
+			_pinned_options.insert(option);
+		}
 	}
 
-	bool_target = arguments.to_bool(L"--compress_mode");
-	if (bool_target != nullopt)
+	if (!config_file.empty())
 	{
-		compress_mode = *bool_target;
+		for (auto& entry : load_config_file(config_file))
+		{
+			overlays.push_back(entry);
+		}
 	}
 
-	bool_target = arguments.to_bool(L"--binary_mode");
-	if (bool_target != nullopt)
+	for (auto& overlay : overlays)
 	{
-		binary_mode = *bool_target;
+		if (contains(overlay.first))
+		{
+			continue;
+		}
+
+		arguments.push_back(overlay.first);
+		arguments.push_back(overlay.second);
 	}
 
-	auto ushort_target = arguments.to_ushort(L"--compress_block_size");
-	if (ushort_target != nullopt)
+	return arguments;
+}
+
+map<string, string> load_config_file(const string& path)
+{
+	map<string, string> entries;
+
+	ifstream stream(path);
+	string line;
+	while (getline(stream, line))
 	{
-		compress_block_size = *ushort_target;
+		string option, value;
+		istringstream line_stream(line);
+		if (!(line_stream >> option) || option[0] == '#')
+		{
+			continue;
+		}
+
+		if (option.compare(0, 2, "--") != 0)
+		{
+			option = "--" + option;
+		}
+
+		if (find(CONFIGURABLE_OPTIONS.begin(), CONFIGURABLE_OPTIONS.end(),
+				 option)
+			== CONFIGURABLE_OPTIONS.end())
+		{
+			continue;
+		}
+
+		getline(line_stream >> ws, value);
+		value.erase(value.find_last_not_of(" \t\r") + 1);
+		entries.insert({ option, value });
 	}
 
-	string_target = arguments.to_string(L"--connection_key");
-	if (string_target != nullopt)
+	return entries;
+}
+
+void watch_config_file(void)
+{
+	error_code error;
+	auto last_write = filesystem::last_write_time(config_file, error);
+
+	unique_lock<mutex> lock(_config_mutex);
+	while (!_config_condition.wait_for(lock, chrono::seconds(1),
+									   []() { return !_config_watching; }))
 	{
-		temp = converter::to_wstring(file::load(*string_target));
-		if (!temp.empty())
+		auto current_write = filesystem::last_write_time(config_file, error);
+		if (error || current_write == last_write)
 		{
-			connection_key = temp;
+			continue;
+		}
+		last_write = current_write;
+
+		// the command line and the environment outrank the file on reload too
+		auto entries = load_config_file(config_file);
+		for (auto& option : _pinned_options)
+		{
+			entries.erase(option);
+		}
+
+		wstring rejected;
+		auto reject = [&rejected](const string& option)
+		{
+			rejected += (rejected.empty() ? L"" : L";")
+						+ converter::to_wstring(option);
+		};
+
+		auto level_target = entries.find("--logging_level");
+		if (level_target != entries.end())
+		{
+			auto level = parse_integer(level_target->second);
+			if (level != nullopt && is_logging_level(*level))
+			{
+				log_level = (logging_level)*level;
+				logger::handle().set_target_level(log_level);
+			}
+			else
+			{
+				reject(level_target->first);
+			}
+		}
+
+		auto compress_target = entries.find("--compress_mode");
+		if (compress_target != entries.end())
+		{
+			auto compress = parse_boolean(compress_target->second);
+			if (compress != nullopt)
+			{
+				compress_mode = *compress;
+				_server->set_compress_mode(compress_mode);
+			}
+			else
+			{
+				reject(compress_target->first);
+			}
+		}
+
+		vector<tuple<string, priorities, unsigned short*>> worker_options
+			= { { "--high_priority_count", priorities::high,
+				  &high_priority_count },
+				{ "--normal_priority_count", priorities::normal,
+				  &normal_priority_count },
+				{ "--low_priority_count", priorities::low,
+				  &low_priority_count } };
+		for (auto& [option, priority, worker_count] : worker_options)
+		{
+			auto worker_target = entries.find(option);
+			if (worker_target == entries.end())
+			{
+				continue;
+			}
+
+			auto requested = parse_integer(worker_target->second);
+			if (requested == nullopt
+				|| !grow_workers(priority, *requested, *worker_count))
+			{
+				reject(option);
+			}
 		}
+
+		if (!rejected.empty())
+		{
+			logger::handle().write(
+				logging_level::error,
+				fmt::format(L"config file has invalid values: {}", rejected));
+		}
+
+		logger::handle().write(
+			logging_level::information,
+			fmt::format(L"config file is reloaded: logging_level={}, "
+						L"compress_mode={}, workers={}/{}/{}, other options "
+						L"apply on restart",
+						(int)log_level.load(), compress_mode.load(),
+						high_priority_count, normal_priority_count,
+						low_priority_count));
 	}
+}
 
-	ushort_target = arguments.to_ushort(L"--server_port");
-	if (ushort_target != nullopt)
+optional<long long> parse_integer(const string& value)
+{
+	char* end = nullptr;
+	errno = 0;
+	long long parsed = strtoll(value.c_str(), &end, 10);
+	if (value.empty() || errno == ERANGE || *end != '\0')
 	{
-		server_port = *ushort_target;
+		return nullopt;
 	}
 
-	ushort_target = arguments.to_ushort(L"--high_priority_count");
-	if (ushort_target != nullopt)
+	return parsed;
+}
+
+optional<bool> parse_boolean(const string& value)
+{
+	string lowered = value;
+	transform(lowered.begin(), lowered.end(), lowered.begin(), ::tolower);
+	if (lowered == "true")
 	{
-		high_priority_count = *ushort_target;
+		return true;
 	}
-
-	ushort_target = arguments.to_ushort(L"--normal_priority_count");
-	if (ushort_target != nullopt)
+	if (lowered == "false")
 	{
-		normal_priority_count = *ushort_target;
+		return false;
 	}
 
-	ushort_target = arguments.to_ushort(L"--low_priority_count");
-	if (ushort_target != nullopt)
+	return nullopt;
+}
+
+bool is_logging_level(const long long& level)
+{
+	return level >= (long long)logging_level::exception
+		   && level <= (long long)logging_level::parameter;
+}
+
+void run_soak_sampler(void)
+{
+	filesystem::path target(soak_file);
+	wofstream stream(target);
+	stream << L"elapsed_sec,rss_bytes,live_bytes,sessions,queue_depth,"
+			  L"received_per_sec,p50_ns,p99_ns,drift"
+		   << endl;
+
+	auto started = chrono::steady_clock::now();
+	unsigned long long last_received = 0;
+	vector<soak_sample> samples;
+
+	unique_lock<mutex> lock(_soak_mutex);
+	while (!_soak_condition.wait_for(lock, chrono::seconds(soak_interval),
+									 []() { return !_soak_running; }))
 	{
-		low_priority_count = *ushort_target;
+		samples.push_back(take_soak_sample(started));
+		auto& sample = samples.back();
+
+		wstring drift = detect_drift(samples);
+		stream << fmt::format(L"{},{},{},{},{},{:.1f},{},{},{}",
+							  sample.elapsed, sample.rss_bytes,
+							  sample.live_bytes, sample.sessions,
+							  sample.queue_depth,
+							  (double)(sample.received - last_received)
+								  / soak_interval,
+							  sample.p50_ns, sample.p99_ns, drift)
+			   << endl;
+		last_received = sample.received;
+
+		if (!drift.empty())
+		{
+			logger::handle().write(
+				logging_level::error,
+				fmt::format(L"soak drift after {} seconds: {}",
+							sample.elapsed, drift));
+		}
 	}
+}
 
-	auto int_target = arguments.to_int(L"--logging_level");
-	if (int_target != nullopt)
+soak_sample take_soak_sample(const chrono::steady_clock::time_point& started)
+{
+	soak_sample sample = {};
+	sample.elapsed = chrono::duration_cast<chrono::seconds>(
+						 chrono::steady_clock::now() - started)
+						 .count();
+	sample.rss_bytes = resident_bytes();
+#ifdef ALLOCATION_TRACKING
+	for (auto& counter : _allocation_counters)
 	{
-		log_level = (logging_level)*int_target;
+		sample.live_bytes += counter.live_bytes.load();
 	}
+#endif
+	sample.sessions = _session_count.load();
+	sample.received = _received_count.load();
+	sample.queue_depth = _in_flight_count.load();
 
-#ifdef _WIN32
-	auto ullong_target = arguments.to_ullong(L"--session_limit_count");
-	if (ullong_target != nullopt)
+	unsigned long long counts[SOAK_BUCKET_COUNT];
+	unsigned long long total = 0;
+	for (size_t bucket = 0; bucket < SOAK_BUCKET_COUNT; ++bucket)
 	{
-		session_limit_count = *ullong_target;
+		counts[bucket]
+			= _soak_histogram[bucket].exchange(0, memory_order_relaxed);
+		total += counts[bucket];
 	}
-#else
-	auto ulong_target = arguments.to_ulong(L"--session_limit_count");
-	if (ulong_target != nullopt)
+
+	auto percentile = [&counts, &total](const double& rank)
 	{
-		session_limit_count = *ulong_target;
-	}
-#endif
+		auto target = (unsigned long long)(rank * (total - 1));
+		unsigned long long seen = 0;
+		for (size_t bucket = 0; bucket < SOAK_BUCKET_COUNT; ++bucket)
+		{
+			seen += counts[bucket];
+			if (seen > target)
+			{
+				return bucket_upper_bound(bucket);
+			}
+		}
 
-	bool_target = arguments.to_bool(L"--write_console_only");
-	if (bool_target != nullopt && *bool_target)
+		return bucket_upper_bound(SOAK_BUCKET_COUNT - 1);
+	};
+
+	if (total > 0)
 	{
-		logging_style = logging_styles::console_only;
+		sample.p50_ns = percentile(0.5);
+		sample.p99_ns = percentile(0.99);
+	}
 
-		return true;
+	return sample;
+}
+
+size_t latency_bucket(const long long& latency)
+{
+	unsigned long long value = latency < 1 ? 1 : (unsigned long long)latency;
+	if (value < (1ULL << SOAK_BUCKET_BITS))
+	{
+		return (size_t)value;
 	}
 
-	bool_target = arguments.to_bool(L"--write_console");
-	if (bool_target != nullopt && *bool_target)
+	size_t exponent = SOAK_BUCKET_BITS;
+	while ((value >> (exponent + 1)) != 0)
 	{
-		logging_style = logging_styles::file_and_console;
+		++exponent;
+	}
 
-		return true;
+	size_t bucket = ((exponent - SOAK_BUCKET_BITS + 1) << SOAK_BUCKET_BITS)
+					+ ((value >> (exponent - SOAK_BUCKET_BITS))
+					   & ((1ULL << SOAK_BUCKET_BITS) - 1));
+
+	return min(bucket, SOAK_BUCKET_COUNT - 1);
+}
+
+long long bucket_upper_bound(const size_t& bucket)
+{
+	if (bucket < (1ULL << SOAK_BUCKET_BITS))
+	{
+		return (long long)bucket;
 	}
 
-	logging_style = logging_styles::file_only;
+	size_t shift = (bucket >> SOAK_BUCKET_BITS) - 1;
+	unsigned long long mantissa
+		= (1ULL << SOAK_BUCKET_BITS)
+		  + (bucket & ((1ULL << SOAK_BUCKET_BITS) - 1));
 
-	return true;
+	return (long long)(((mantissa + 1) << shift) - 1);
 }
 
-void display_help(void)
+wstring detect_drift(const vector<soak_sample>& samples)
 {
-	wcout << L"pathfinder options:" << endl << endl;
-	wcout << L"--encrypt_mode [value] " << endl;
-	wcout << L"\tThe encrypt_mode on/off. If you want to use encrypt mode must "
-			 L"be appended '--encrypt_mode true'.\n\tInitialize value is "
-			 L"--encrypt_mode off."
-		  << endl
-		  << endl;
-	wcout << L"--compress_mode [value]" << endl;
-	wcout
-		<< L"\tThe compress_mode on/off. If you want to use compress mode must "
-		   L"be appended '--compress_mode true'.\n\tInitialize value is "
-		   L"--compress_mode off."
-		<< endl
-		<< endl;
+	vector<wstring> flags;
+
+	// growth on every one of the last samples points at a leak
+	auto growing = [&samples](long long soak_sample::*field)
+	{
+		if (samples.size() <= SOAK_DRIFT_WINDOW)
+		{
+			return false;
+		}
+
+		for (size_t index = samples.size() - SOAK_DRIFT_WINDOW;
+			 index < samples.size(); ++index)
+		{
+			if (samples[index].*field <= samples[index - 1].*field)
+			{
+				return false;
+			}
+		}
+
+		return true;
+	};
+
+	if (growing(&soak_sample::rss_bytes))
+	{
+		flags.push_back(L"rss_growth");
+	}
+	if (growing(&soak_sample::live_bytes))
+	{
+		flags.push_back(L"live_bytes_growth");
+	}
+
+	// the first sample with traffic is the latency baseline
+	auto baseline = find_if(samples.begin(), samples.end(),
+							[](const soak_sample& sample)
+							{ return sample.p99_ns > 0; });
+	if (baseline != samples.end() && &*baseline != &samples.back()
+		&& samples.back().p99_ns > baseline->p99_ns * 2)
+	{
+		flags.push_back(L"p99_drift");
+	}
+
+	wstring result;
+	for (auto& flag : flags)
+	{
+		result += (result.empty() ? L"" : L";") + flag;
+	}
+
+	return result;
+}
+
+long long resident_bytes(void)
+{
+#ifdef _WIN32
+	return 0;
+#else
+	long long pages = 0;
+	long long resident = 0;
+	ifstream stream("/proc/self/statm");
+	if (!(stream >> pages >> resident))
+	{
+		return 0;
+	}
+
+	return resident * sysconf(_SC_PAGESIZE);
+#endif
+}
+
+bool parse_arguments(argument_manager& arguments)
+{
+	wstring temp;
+
+	auto string_target = arguments.to_string(L"--help");
+	if (string_target != nullopt)
+	{
+		display_help();
+
+		return false;
+	}
+
+	auto bool_target = arguments.to_bool(L"--encrypt_mode");
+	if (bool_target != nullopt)
+	{
+		encrypt_mode = *bool_target;
+	}
+
+	bool_target = arguments.to_bool(L"--compress_mode");
+	if (bool_target != nullopt)
+	{
+		compress_mode = *bool_target;
+	}
+
+	bool_target = arguments.to_bool(L"--binary_mode");
+	if (bool_target != nullopt)
+	{
+		binary_mode = *bool_target;
+	}
+
+	auto ushort_target = arguments.to_ushort(L"--compress_block_size");
+	if (ushort_target != nullopt)
+	{
+		compress_block_size = *ushort_target;
+	}
+
+	string_target = arguments.to_string(L"--connection_key");
+	if (string_target != nullopt)
+	{
+		temp = converter::to_wstring(file::load(*string_target));
+		if (!temp.empty())
+		{
+			connection_key = temp;
+		}
+	}
+
+	ushort_target = arguments.to_ushort(L"--server_port");
+	if (ushort_target != nullopt)
+	{
+		server_port = *ushort_target;
+	}
+
+	ushort_target = arguments.to_ushort(L"--high_priority_count");
+	if (ushort_target != nullopt)
+	{
+		high_priority_count = *ushort_target;
+	}
+
+	ushort_target = arguments.to_ushort(L"--normal_priority_count");
+	if (ushort_target != nullopt)
+	{
+		normal_priority_count = *ushort_target;
+	}
+
+	ushort_target = arguments.to_ushort(L"--low_priority_count");
+	if (ushort_target != nullopt)
+	{
+		low_priority_count = *ushort_target;
+	}
+
+	auto int_target = arguments.to_int(L"--logging_level");
+	if (int_target != nullopt)
+	{
+		log_level = (logging_level)*int_target;
+	}
+
+#ifdef _WIN32
+	auto ullong_target = arguments.to_ullong(L"--session_limit_count");
+	if (ullong_target != nullopt)
+	{
+		session_limit_count = *ullong_target;
+	}
+#else
+	auto ulong_target = arguments.to_ulong(L"--session_limit_count");
+	if (ulong_target != nullopt)
+	{
+		session_limit_count = *ulong_target;
+	}
+#endif
+
+	bool_target = arguments.to_bool(L"--admin_mode");
+	if (bool_target != nullopt)
+	{
+		admin_mode = *bool_target;
+	}
+
+	string_target = arguments.to_string(L"--trace_file");
+	if (string_target != nullopt)
+	{
+		trace_file = *string_target;
+	}
+
+	string_target = arguments.to_string(L"--profile_file");
+	if (string_target != nullopt)
+	{
+		profile_file = *string_target;
+	}
+
+	ushort_target = arguments.to_ushort(L"--profile_frequency");
+	if (ushort_target != nullopt && *ushort_target > 0)
+	{
+		profile_frequency = *ushort_target;
+	}
+
+	string_target = arguments.to_string(L"--soak_file");
+	if (string_target != nullopt)
+	{
+		soak_file = *string_target;
+	}
+
+	ushort_target = arguments.to_ushort(L"--soak_interval");
+	if (ushort_target != nullopt && *ushort_target > 0)
+	{
+		soak_interval = *ushort_target;
+	}
+
+	ushort_target = arguments.to_ushort(L"--shutdown_timeout");
+	if (ushort_target != nullopt)
+	{
+		shutdown_timeout = *ushort_target;
+	}
+
+	bool_target = arguments.to_bool(L"--write_console_only");
+	if (bool_target != nullopt && *bool_target)
+	{
+		logging_style = logging_styles::console_only;
+
+		return true;
+	}
+
+	bool_target = arguments.to_bool(L"--write_console");
+	if (bool_target != nullopt && *bool_target)
+	{
+		logging_style = logging_styles::file_and_console;
+
+		return true;
+	}
+
+	logging_style = logging_styles::file_only;
+
+	return true;
+}
+
+void display_help(void)
+{
+	wcout << L"pathfinder options:" << endl << endl;
+	wcout << L"--encrypt_mode [value] " << endl;
+	wcout << L"\tThe encrypt_mode on/off. If you want to use encrypt mode must "
+			 L"be appended '--encrypt_mode true'.\n\tInitialize value is "
+			 L"--encrypt_mode off."
+		  << endl
+		  << endl;
+	wcout << L"--compress_mode [value]" << endl;
+	wcout
+		<< L"\tThe compress_mode on/off. If you want to use compress mode must "
+		   L"be appended '--compress_mode true'.\n\tInitialize value is "
+		   L"--compress_mode off."
+		<< endl
+		<< endl;
 	wcout << L"--compress_block_size [value]" << endl;
 	wcout
 		<< L"\tThe compress_mode on/off. If you want to change compress block "
@@ -308,6 +1167,61 @@ void display_help(void)
 			 L"'--session_limit_count [count]'."
 		  << endl
 		  << endl;
+	wcout << L"--admin_mode [value]" << endl;
+	wcout << L"\tThe admin_mode on/off. If you want to accept 'admin_control' "
+			 L"messages must be appended\n\t'--admin_mode true'. Keep it on a "
+			 L"local port only. It is refused with the default\n\t"
+			 L"--connection_key. Worker counts can only grow, up to 4 times "
+			 L"their\n\tstartup value.\n\tInitialize value is --admin_mode "
+			 L"off."
+		  << endl
+		  << endl;
+	wcout << L"--config_file [value]" << endl;
+	wcout << L"\tIf you want to load options from a file must be appended "
+			 L"'--config_file [path]'.\n\tEach line holds 'option value' and "
+			 L"ECHO_SERVER_[OPTION] environment\n\tvariables override it. "
+			 L"logging_level, compress_mode and\n\tgrowing worker counts are "
+			 L"reloaded while running unless the command line or the\n\t"
+			 L"environment sets them."
+		  << endl
+		  << endl;
+	wcout << L"--trace_file [value]" << endl;
+	wcout << L"\tIf you want to record spans of traced echo messages in "
+			 L"Chrome trace format must be\n\tappended '--trace_file "
+			 L"[path]'."
+		  << endl
+		  << endl;
+	wcout << L"--profile_file [value]" << endl;
+	wcout << L"\tIf you want to sample CPU time per subsystem into folded "
+			 L"stacks must be appended\n\t'--profile_file [path]'. It is "
+			 L"not supported on Windows."
+		  << endl
+		  << endl;
+	wcout << L"--profile_frequency [value]" << endl;
+	wcout << L"\tIf you want to change the sampling frequency must be "
+			 L"appended '--profile_frequency [hz]'.\n\tInitialize value is "
+			 L"--profile_frequency 99."
+		  << endl
+		  << endl;
+	wcout << L"--soak_file [value]" << endl;
+	wcout << L"\tIf you want to sample memory, sessions, queue depth and "
+			 L"latency into a CSV and flag\n\tgrowth or drift on long runs "
+			 L"must be appended '--soak_file [path]'."
+		  << endl
+		  << endl;
+	wcout << L"--soak_interval [value]" << endl;
+	wcout << L"\tIf you want to change the soak sampling interval must be "
+			 L"appended\n\t'--soak_interval [seconds]'.\n\tInitialize value "
+			 L"is --soak_interval 60."
+		  << endl
+		  << endl;
+	wcout << L"--shutdown_timeout [value]" << endl;
+	wcout << L"\tIf you want to change how long pending jobs are drained on "
+			 L"shutdown must be appended\n\t'--shutdown_timeout "
+			 L"[milliseconds]'.\n\tInitialize value is --shutdown_timeout "
+			 L"5000."
+		  << endl
+		  << endl;
 	wcout << L"--write_console [value] " << endl;
 	wcout << L"\tThe write_console_mode on/off. If you want to display log on "
 			 L"console must be appended '--write_console true'.\n\tInitialize "
@@ -354,29 +1268,80 @@ void create_thread_pool(void)
 		_thread_pool.reset();
 	}
 
+	auto limit = [](const unsigned short& worker_count)
+	{ return max<long long>(worker_count, 1) * MAX_WORKER_SCALE; };
+	_worker_limits = { { priorities::high, limit(high_priority_count) },
+					   { priorities::normal, limit(normal_priority_count) },
+					   { priorities::low, limit(low_priority_count) } };
+
 	_thread_pool = make_shared<thread_pool>();
 	for (unsigned short high = 0; high < high_priority_count; ++high)
 	{
-		_thread_pool->append(make_shared<thread_worker>(priorities::high));
+		_thread_pool->append(create_worker(priorities::high));
 	}
 	for (unsigned short normal = 0; normal < normal_priority_count; ++normal)
 	{
-		_thread_pool->append(make_shared<thread_worker>(
-			priorities::normal, vector<priorities>{ priorities::high }));
+		_thread_pool->append(create_worker(priorities::normal));
 	}
 	for (unsigned short low = 0; low < low_priority_count; ++low)
 	{
-		_thread_pool->append(make_shared<thread_worker>(
-			priorities::low,
-			vector<priorities>{ priorities::high, priorities::normal }));
+		_thread_pool->append(create_worker(priorities::low));
 	}
 	_thread_pool->start();
 }
 
+shared_ptr<thread_worker> create_worker(const priorities& priority)
+{
+	switch (priority)
+	{
+	case priorities::normal:
+		return make_shared<thread_worker>(
+			priorities::normal, vector<priorities>{ priorities::high });
+	case priorities::low:
+		return make_shared<thread_worker>(
+			priorities::low,
+			vector<priorities>{ priorities::high, priorities::normal });
+	default:
+		return make_shared<thread_worker>(priorities::high);
+	}
+}
+
+bool grow_workers(const priorities& priority,
+				  const long long& requested,
+				  unsigned short& worker_count)
+{
+	scoped_lock<mutex> guard(_worker_mutex);
+
+	// running workers cannot be detached from a thread_pool, so a shrink is
+	// refused like an out of range value
+	auto limit = _worker_limits.find(priority);
+	if (limit == _worker_limits.end() || requested < worker_count
+		|| requested > limit->second)
+	{
+		return false;
+	}
+
+	for (; worker_count < requested; ++worker_count)
+	{
+		_thread_pool->append(create_worker(priority), true);
+	}
+
+	return true;
+}
+
 void connection(const wstring& target_id,
 				const wstring& target_sub_id,
 				const bool& condition)
 {
+	if (condition)
+	{
+		++_session_count;
+	}
+	else if (_session_count > 0)
+	{
+		--_session_count;
+	}
+
 	logger::handle().write(
 		logging_level::information,
 		fmt::format(L"an echo_client({}[{}]) is {} an echo_server", target_id,
@@ -386,27 +1351,135 @@ void connection(const wstring& target_id,
 
 void received_message(shared_ptr<container::value_container> container)
 {
+	subsystem_scope scope(subsystem_tags::network_receive);
+
 	if (container == nullptr)
 	{
 		return;
 	}
 
+	if (!_accepting)
+	{
+		logger::handle().write(
+			logging_level::error,
+			fmt::format(L"dropped message on shutdown: {}",
+						container->message_type()));
+
+		return;
+	}
+
+	++_received_count;
+
 	auto message_type = _registered_messages.find(container->message_type());
 	if (message_type != _registered_messages.end())
 	{
-		if (_thread_pool)
+		if (_thread_pool == nullptr)
 		{
-			_thread_pool->push(make_shared<job>(
-				priorities::high, converter::to_array(container->serialize()),
-				message_type->second));
+			return;
+		}
+
+		bool first_pending = false;
+		{
+			// checked under the lock so shutdown_server cannot read the
+			// in-flight count between this check and the increment
+			scoped_lock<mutex> guard(_pending_mutex);
+			if (!_accepting)
+			{
+				return;
+			}
+
+			_pending_messages.push_back(
+				{ container, chrono::steady_clock::now(), wall_clock_ns() });
+			++_in_flight_count;
+			first_pending = (_pending_messages.size() == 1);
+		}
+
+		// messages arriving while a drain job is queued ride on that job
+		if (first_pending)
+		{
+			_thread_pool->push(
+				make_shared<job>(priorities::high, &process_pending_messages));
 		}
 
 		return;
 	}
 
-	logger::handle().write(
-		logging_level::information,
-		fmt::format(L"received message: {}", container->serialize()));
+	// serialize() is only paid for when the record is written
+	if (log_level.load() >= logging_level::information)
+	{
+		logger::handle().write(
+			logging_level::information,
+			fmt::format(L"received message: {}", container->serialize()));
+	}
+}
+
+void process_pending_messages(void)
+{
+	subsystem_scope scope(subsystem_tags::queue_drain);
+
+	vector<pending_message> messages;
+	{
+		scoped_lock<mutex> guard(_pending_mutex);
+		messages.swap(_pending_messages);
+	}
+
+	auto dequeued = chrono::steady_clock::now();
+	long long dequeued_time = wall_clock_ns();
+	for (auto& message : messages)
+	{
+		auto message_type
+			= _registered_messages.find(message.container->message_type());
+		if (message_type == _registered_messages.end())
+		{
+			--_in_flight_count;
+			continue;
+		}
+
+		{
+			subsystem_scope parsing(subsystem_tags::deserialize);
+			_current_trace = read_trace_context(message.container);
+
+			// echo_client --latency_breakdown stamps its send time
+			auto client_send
+				= message.container->get_value(L"client_send_time");
+			if (client_send != nullptr && !client_send->is_null())
+			{
+				_current_latency = { client_send->to_llong(),
+									 message.received_time, dequeued_time, 0 };
+			}
+		}
+		record_span(L"queue_wait", message.received, dequeued);
+
+		auto handler_tag = _handler_tags.find(message_type->first);
+		auto handler_start = chrono::steady_clock::now();
+		if (_current_latency.client_send != 0)
+		{
+			_current_latency.handler_started = wall_clock_ns();
+		}
+		{
+			subsystem_scope handling(
+				handler_tag != _handler_tags.end()
+					? handler_tag->second
+					: (size_t)subsystem_tags::untagged);
+			message_type->second(message.container);
+		}
+		auto handler_end = chrono::steady_clock::now();
+		record_span(fmt::format(L"handler:{}", message_type->first),
+					handler_start, handler_end);
+
+		if (!soak_file.empty())
+		{
+			_soak_histogram[latency_bucket(
+								chrono::duration_cast<chrono::nanoseconds>(
+									handler_end - message.received)
+									.count())]
+				.fetch_add(1, memory_order_relaxed);
+		}
+
+		_current_trace = trace_context();
+		_current_latency = latency_context();
+		--_in_flight_count;
+	}
 }
 
 void received_binary_message(const wstring& source_id,
@@ -415,36 +1488,505 @@ void received_binary_message(const wstring& source_id,
 							 const wstring& target_sub_id,
 							 const vector<uint8_t>& data)
 {
-	logger::handle().write(logging_level::information,
-						   fmt::format(L"received message: {}[{}] = {}",
-									   source_id, source_sub_id,
-									   converter::to_wstring(data)));
+	subsystem_scope scope(subsystem_tags::network_receive);
+
+	if (!_accepting)
+	{
+		return;
+	}
+
+	if (log_level.load() >= logging_level::information)
+	{
+		logger::handle().write(logging_level::information,
+							   fmt::format(L"received message: {}[{}] = {}",
+										   source_id, source_sub_id,
+										   converter::to_wstring(data)));
+	}
 
 	_server->send_binary(source_id, source_sub_id, data);
 }
 
-void received_echo_test(const vector<uint8_t>& data)
+void received_echo_test(shared_ptr<container::value_container> container)
 {
-	if (data.empty())
+	if (container == nullptr)
 	{
 		return;
 	}
 
-	shared_ptr<container::value_container> container
-		= make_shared<container::value_container>(data, false);
+	if (log_level.load() >= logging_level::information)
+	{
+		logger::handle().write(
+			logging_level::information,
+			fmt::format(L"{}received message: {}", trace_prefix(),
+						container->serialize()));
+	}
+
+	shared_ptr<container::value_container> message = container->copy(false);
+	message->swap_header();
+	write_trace_context(message);
+
+	auto payload = container->get_value(L"payload");
+	if (payload != nullptr && !payload->is_null())
+	{
+		message->add(string_value(L"payload", payload->to_string()));
+	}
+
+	auto send_start = chrono::steady_clock::now();
+	{
+		subsystem_scope sending(subsystem_tags::send);
+		write_latency_context(message);
+		_server->send(message);
+	}
+	record_span(L"send", send_start, chrono::steady_clock::now());
+}
+
+void received_admin_control(
+	shared_ptr<container::value_container> container)
+{
 	if (container == nullptr)
 	{
 		return;
 	}
 
+	wstring rejected;
+
+	auto target = container->get_value(L"logging_level");
+	if (target != nullptr && !target->is_null())
+	{
+		if (is_logging_level(target->to_llong()))
+		{
+			log_level = (logging_level)target->to_llong();
+			logger::handle().set_target_level(log_level);
+		}
+		else
+		{
+			rejected = L"logging_level";
+		}
+	}
+
+	target = container->get_value(L"compress_mode");
+	if (target != nullptr && !target->is_null())
+	{
+		compress_mode = target->to_boolean();
+		_server->set_compress_mode(compress_mode);
+	}
+
+	vector<tuple<wstring, priorities, unsigned short*>> worker_options
+		= { { L"high_priority_count", priorities::high, &high_priority_count },
+			{ L"normal_priority_count", priorities::normal,
+			  &normal_priority_count },
+			{ L"low_priority_count", priorities::low, &low_priority_count } };
+
+	for (auto& [name, priority, worker_count] : worker_options)
+	{
+		target = container->get_value(name);
+		if (target == nullptr || target->is_null())
+		{
+			continue;
+		}
+
+		if (!grow_workers(priority, target->to_llong(), *worker_count))
+		{
+			rejected += (rejected.empty() ? L"" : L";") + name;
+		}
+	}
+
+	if (!rejected.empty())
+	{
+		logger::handle().write(
+			logging_level::error,
+			fmt::format(L"admin control from {}[{}] rejected out of range "
+						L"values: {}",
+						container->source_id(), container->source_sub_id(),
+						rejected));
+	}
+
 	logger::handle().write(
 		logging_level::information,
-		fmt::format(L"received message: {}", container->serialize()));
+		fmt::format(L"admin control from {}[{}]: logging_level={}, "
+					L"compress_mode={}, workers={}/{}/{}",
+					container->source_id(), container->source_sub_id(),
+					(int)log_level.load(), compress_mode.load(),
+					high_priority_count,
+					normal_priority_count, low_priority_count));
 
 	shared_ptr<container::value_container> message = container->copy(false);
 	message->swap_header();
+	message->add(
+		make_shared<ullong_value>(L"session_count", _session_count.load()));
+	message->add(
+		make_shared<ullong_value>(L"received_count", _received_count.load()));
+	message->add(
+		make_shared<ullong_value>(L"logging_level", (int)log_level.load()));
+	message->add(
+		make_shared<bool_value>(L"compress_mode", compress_mode.load()));
+	message->add(
+		make_shared<ullong_value>(L"high_priority_count", high_priority_count));
+	message->add(make_shared<ullong_value>(L"normal_priority_count",
+										   normal_priority_count));
+	message->add(
+		make_shared<ullong_value>(L"low_priority_count", low_priority_count));
+	if (!rejected.empty())
+	{
+		message->add(make_shared<string_value>(L"rejected", rejected));
+	}
+#ifdef ALLOCATION_TRACKING
+	for (auto& snapshot : take_allocation_snapshot())
+	{
+		message->add(make_shared<ullong_value>(
+			fmt::format(L"allocation_count:{}", snapshot.name),
+			snapshot.count));
+		message->add(make_shared<ullong_value>(
+			fmt::format(L"allocation_peak_bytes:{}", snapshot.name),
+			(unsigned long long)max(snapshot.peak_bytes, 0LL)));
+	}
+#endif
 
 	_server->send(message);
 }
 
-void signal_callback(int signum) { _server->stop(); }
\ No newline at end of file
+trace_context read_trace_context(
+	shared_ptr<container::value_container> container)
+{
+	trace_context context;
+
+	auto target = container->get_value(L"trace_id");
+	if (target == nullptr || target->is_null())
+	{
+		return context;
+	}
+
+	wstring trace_id = target->to_string();
+
+	target = container->get_value(L"span_id");
+	wstring span_id = (target != nullptr && !target->is_null())
+						  ? target->to_string()
+						  : L"";
+
+	// ids are written into trace JSON and log lines, so only the hex ids
+	// echo_client generates are accepted
+	if (!is_hex_id(trace_id, 32) || !is_hex_id(span_id, 16))
+	{
+		return context;
+	}
+
+	context.trace_id = trace_id;
+	context.span_id = span_id;
+
+	target = container->get_value(L"trace_sampled");
+	if (target != nullptr && !target->is_null())
+	{
+		context.sampled = target->to_boolean();
+	}
+
+	return context;
+}
+
+void write_trace_context(shared_ptr<container::value_container> container)
+{
+	if (_current_trace.trace_id.empty())
+	{
+		return;
+	}
+
+	container->add(string_value(L"trace_id", _current_trace.trace_id));
+	container->add(string_value(L"span_id", _current_trace.span_id));
+	container->add(bool_value(L"trace_sampled", _current_trace.sampled));
+}
+
+void write_latency_context(shared_ptr<container::value_container> container)
+{
+	if (_current_latency.client_send == 0)
+	{
+		return;
+	}
+
+	container->add(
+		llong_value(L"client_send_time", _current_latency.client_send));
+	container->add(
+		llong_value(L"server_receive_time", _current_latency.received));
+	container->add(
+		llong_value(L"server_dequeue_time", _current_latency.dequeued));
+	container->add(llong_value(L"server_handler_time",
+							   _current_latency.handler_started));
+	container->add(llong_value(L"server_send_time", wall_clock_ns()));
+}
+
+long long wall_clock_ns(void)
+{
+	return chrono::duration_cast<chrono::nanoseconds>(
+			   chrono::system_clock::now().time_since_epoch())
+		.count();
+}
+
+bool is_hex_id(const wstring& identifier, const size_t& length)
+{
+	return identifier.size() == length
+		   && all_of(identifier.begin(), identifier.end(),
+					 [](const wchar_t& character)
+					 {
+						 return (character >= L'0' && character <= L'9')
+								|| (character >= L'a' && character <= L'f')
+								|| (character >= L'A' && character <= L'F');
+					 });
+}
+
+wstring trace_prefix(void)
+{
+	if (_current_trace.trace_id.empty())
+	{
+		return L"";
+	}
+
+	return fmt::format(L"[trace {}] ", _current_trace.trace_id);
+}
+
+void record_span(const wstring& name,
+				 const chrono::steady_clock::time_point& start,
+				 const chrono::steady_clock::time_point& end)
+{
+	if (trace_file.empty() || !_current_trace.sampled)
+	{
+		return;
+	}
+
+	trace_span span{ name,
+					 _current_trace.trace_id,
+					 _current_trace.span_id,
+					 chrono::duration_cast<chrono::microseconds>(
+						 start.time_since_epoch())
+						 .count(),
+					 chrono::duration_cast<chrono::microseconds>(end - start)
+						 .count(),
+					 hash<thread::id>()(this_thread::get_id()) };
+
+	scoped_lock<mutex> guard(_trace_mutex);
+	if (_trace_spans.size() < MAX_TRACE_SPANS)
+	{
+		_trace_spans.push_back(move(span));
+	}
+}
+
+void export_trace_spans(void)
+{
+	if (trace_file.empty())
+	{
+		return;
+	}
+
+#ifdef _WIN32
+	int process_id = _getpid();
+#else
+	int process_id = getpid();
+#endif
+
+	scoped_lock<mutex> guard(_trace_mutex);
+
+	filesystem::path target(trace_file);
+	wofstream stream(target);
+	stream << L"{\"traceEvents\":[";
+	for (size_t index = 0; index < _trace_spans.size(); ++index)
+	{
+		auto& span = _trace_spans[index];
+		stream << fmt::format(
+			L"{}{{\"name\":\"{}\",\"cat\":\"{}\",\"ph\":\"X\","
+			L"\"ts\":{},\"dur\":{},\"pid\":{},\"tid\":{},"
+			L"\"args\":{{\"trace_id\":\"{}\",\"parent_id\":\"{}\"}}}}",
+			index == 0 ? L"" : L",", span.name, PROGRAM_NAME, span.start,
+			span.duration, process_id, span.thread_id % 1000000,
+			span.trace_id, span.parent_id);
+	}
+	stream << L"]}" << endl;
+
+	logger::handle().write(
+		logging_level::information,
+		fmt::format(L"{} trace spans are exported", _trace_spans.size()));
+}
+
+void register_subsystem_tags(void)
+{
+	for (auto& registered : _registered_messages)
+	{
+		if (_subsystem_names.size() >= MAX_SUBSYSTEM_TAGS)
+		{
+			break;
+		}
+
+		_handler_tags.insert({ registered.first, _subsystem_names.size() });
+		_subsystem_names.push_back(
+			fmt::format(L"handler;{}", registered.first));
+	}
+}
+
+void start_profiler(void)
+{
+	if (profile_file.empty())
+	{
+		return;
+	}
+
+#ifdef _WIN32
+	logger::handle().write(logging_level::error,
+						   L"profile_file is not supported on Windows");
+#else
+	struct sigaction action = {};
+	action.sa_handler = profile_callback;
+	action.sa_flags = SA_RESTART;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGPROF, &action, nullptr);
+
+	long interval = 1000000L / profile_frequency;
+	struct itimerval timer = {};
+	timer.it_interval.tv_sec = interval / 1000000L;
+	timer.it_interval.tv_usec = interval % 1000000L;
+	timer.it_value = timer.it_interval;
+	setitimer(ITIMER_PROF, &timer, nullptr);
+#endif
+}
+
+void stop_profiler(void)
+{
+	if (profile_file.empty())
+	{
+		return;
+	}
+
+#ifndef _WIN32
+	struct itimerval timer = {};
+	setitimer(ITIMER_PROF, &timer, nullptr);
+
+	filesystem::path target(profile_file);
+	wofstream stream(target);
+	for (size_t index = 0; index < _subsystem_names.size(); ++index)
+	{
+		auto samples = _profile_samples[index].load();
+		if (samples == 0)
+		{
+			continue;
+		}
+
+		stream << fmt::format(L"{};{} {}", PROGRAM_NAME,
+							  _subsystem_names[index], samples)
+			   << endl;
+	}
+#endif
+}
+
+void profile_callback(int signum)
+{
+	// SIGPROF is the only registered signal
+	(void)signum;
+
+	// lock-free atomics only: this runs inside SIGPROF on any thread
+	size_t tag = (size_t)_subsystem_tag;
+	_profile_samples[tag].fetch_add(1, memory_order_relaxed);
+}
+
+#ifdef ALLOCATION_TRACKING
+vector<allocation_snapshot> take_allocation_snapshot(void)
+{
+	vector<allocation_snapshot> snapshots;
+	for (size_t index = 0; index < _subsystem_names.size(); ++index)
+	{
+		auto& counter = _allocation_counters[index];
+		if (counter.count.load() == 0)
+		{
+			continue;
+		}
+
+		snapshots.push_back({ _subsystem_names[index], counter.count.load(),
+							  counter.bytes.load(), counter.live_bytes.load(),
+							  counter.peak_bytes.load() });
+	}
+
+	return snapshots;
+}
+
+void write_allocation_snapshot(void)
+{
+	for (auto& snapshot : take_allocation_snapshot())
+	{
+		logger::handle().write(
+			logging_level::information,
+			fmt::format(L"allocations of {}: count={}, bytes={}, live={}, "
+						L"peak={}",
+						snapshot.name, snapshot.count, snapshot.bytes,
+						snapshot.live_bytes, snapshot.peak_bytes));
+	}
+}
+#endif
+
+void wait_shutdown_signal(void)
+{
+#ifdef _WIN32
+	WaitForSingleObject(_shutdown_event, INFINITE);
+
+	// main sets the event without a request when it exits normally
+	if (!_shutdown_requested.load())
+	{
+		return;
+	}
+#else
+	char signal_byte = 0;
+	while (read(_shutdown_pipe[0], &signal_byte, 1) < 0 && errno == EINTR)
+	{
+	}
+
+	// the write end is closed without a byte when main exits normally
+	if (signal_byte == 0)
+	{
+		return;
+	}
+#endif
+
+	shutdown_server();
+}
+
+void shutdown_server(void)
+{
+	logger::handle().write(logging_level::information,
+						   L"shutdown requested, draining pending messages");
+
+	// new messages are dropped so the drain has a fixed amount of work, and
+	// the server keeps running until the accepted replies are sent
+	{
+		scoped_lock<mutex> guard(_pending_mutex);
+		_accepting = false;
+	}
+
+	auto deadline = chrono::steady_clock::now()
+					+ chrono::milliseconds(shutdown_timeout);
+	while (_in_flight_count.load() > 0
+		   && chrono::steady_clock::now() < deadline)
+	{
+		this_thread::sleep_for(chrono::milliseconds(10));
+	}
+
+	if (_in_flight_count.load() > 0)
+	{
+		logger::handle().write(
+			logging_level::error,
+			fmt::format(L"{} pending messages were not drained within {} ms",
+						_in_flight_count.load(), shutdown_timeout));
+	}
+
+	if (_server != nullptr)
+	{
+		_server->stop();
+	}
+}
+
+void signal_callback(int signum)
+{
+	// only SIGINT and SIGTERM are registered, both request a shutdown
+	(void)signum;
+
+#ifdef _WIN32
+	_shutdown_requested = true;
+	SetEvent(_shutdown_event);
+#else
+	const char signal_byte = 1;
+	auto written = write(_shutdown_pipe[1], &signal_byte, 1);
+	(void)written;
+#endif
+}
\ No newline at end of file
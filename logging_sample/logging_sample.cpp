@@ -38,7 +38,13 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "fmt/format.h"
 #include "fmt/xchar.h"
 
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <thread>
+#include <vector>
 
 constexpr auto PROGRAM_NAME = L"logging_sample";
 
@@ -53,9 +59,19 @@ logging_styles logging_style = logging_styles::console_only;
 logging_level log_level = logging_level::information;
 logging_styles logging_style = logging_styles::file_only;
 #endif
+bool benchmark_mode = false;
+unsigned short producer_count = 8;
+unsigned int message_count = 10000;
+wstring benchmark_file = L"logging_benchmark.csv";
 
 bool parse_arguments(argument_manager& arguments);
 void display_help(void);
+void run_benchmark(void);
+void run_benchmark_case(const wstring& style_name,
+						const logging_styles& style,
+						const bool& filtered,
+						const unsigned short& producers,
+						wostream& report);
 
 int main(int argc, char* argv[])
 {
@@ -65,6 +81,13 @@ int main(int argc, char* argv[])
 		return 0;
 	}
 
+	if (benchmark_mode)
+	{
+		run_benchmark();
+
+		return 0;
+	}
+
 	logger::handle().set_write_console(logging_style);
 	logger::handle().set_target_level(log_level);
 #ifdef _WIN32
@@ -118,7 +141,31 @@ bool parse_arguments(argument_manager& arguments)
 		log_level = (logging_level)*int_target;
 	}
 
-	auto bool_target = arguments.to_bool(L"--write_console_only");
+	auto bool_target = arguments.to_bool(L"--benchmark_mode");
+	if (bool_target != nullopt)
+	{
+		benchmark_mode = *bool_target;
+	}
+
+	auto ushort_target = arguments.to_ushort(L"--producer_count");
+	if (ushort_target != nullopt && *ushort_target > 0)
+	{
+		producer_count = *ushort_target;
+	}
+
+	int_target = arguments.to_int(L"--message_count");
+	if (int_target != nullopt && *int_target > 0)
+	{
+		message_count = (unsigned int)*int_target;
+	}
+
+	string_target = arguments.to_string(L"--benchmark_file");
+	if (string_target != nullopt && !string_target->empty())
+	{
+		benchmark_file = *string_target;
+	}
+
+	bool_target = arguments.to_bool(L"--write_console_only");
 	if (bool_target != nullopt && *bool_target)
 	{
 		logging_style = logging_styles::console_only;
@@ -142,6 +189,30 @@ bool parse_arguments(argument_manager& arguments)
 void display_help(void)
 {
 	wcout << L"logging sample options:" << endl << endl;
+	wcout << L"--benchmark_mode [value] " << endl;
+	wcout << L"\tThe benchmark_mode on/off. If you want to measure the logger "
+			 L"must be appended '--benchmark_mode true'.\n\tInitialize value "
+			 L"is --benchmark_mode off."
+		  << endl
+		  << endl;
+	wcout << L"--producer_count [value]" << endl;
+	wcout << L"\tIf you want to change the maximum producer threads on "
+			 L"benchmark mode must be appended\n\t'--producer_count "
+			 L"[count]'.\n\tInitialize value is --producer_count 8."
+		  << endl
+		  << endl;
+	wcout << L"--message_count [value]" << endl;
+	wcout << L"\tIf you want to change the messages per producer on benchmark "
+			 L"mode must be appended\n\t'--message_count [count]'.\n\t"
+			 L"Initialize value is --message_count 10000."
+		  << endl
+		  << endl;
+	wcout << L"--benchmark_file [value]" << endl;
+	wcout << L"\tIf you want to change the CSV report of benchmark mode must "
+			 L"be appended\n\t'--benchmark_file [path]'.\n\tInitialize value "
+			 L"is --benchmark_file logging_benchmark.csv."
+		  << endl
+		  << endl;
 	wcout << L"--write_console [value] " << endl;
 	wcout << L"\tThe write_console_mode on/off. If you want to display log on "
 			 L"console must be appended '--write_console true'.\n\tInitialize "
@@ -153,3 +224,113 @@ void display_help(void)
 			 L"'--logging_level [level]'."
 		  << endl;
 }
+
+void run_benchmark(void)
+{
+	vector<pair<wstring, logging_styles>> styles
+		= { { L"console_only", logging_styles::console_only },
+			{ L"file_only", logging_styles::file_only },
+			{ L"file_and_console", logging_styles::file_and_console } };
+
+	// console styles write the records to stdout, so the report has its file
+	filesystem::path target(benchmark_file);
+	wofstream report(target);
+	report << L"style,level,producers,records,records_per_sec,p50_ns,p90_ns,"
+			  L"p99_ns,p999_ns,max_ns,stop_ms"
+		   << endl;
+
+	for (auto& style : styles)
+	{
+		for (auto filtered : { false, true })
+		{
+			for (unsigned int producers = 1; producers < producer_count;
+				 producers *= 2)
+			{
+				run_benchmark_case(style.first, style.second, filtered,
+								   (unsigned short)producers, report);
+			}
+			run_benchmark_case(style.first, style.second, filtered,
+							   producer_count, report);
+		}
+	}
+
+	wcerr << fmt::format(L"benchmark report is written to {}", benchmark_file)
+		  << endl;
+}
+
+void run_benchmark_case(const wstring& style_name,
+						const logging_styles& style,
+						const bool& filtered,
+						const unsigned short& producers,
+						wostream& report)
+{
+	logger::handle().set_write_console(style);
+	logger::handle().set_target_level(logging_level::information);
+#ifdef _WIN32
+	logger::handle().start(PROGRAM_NAME, locale("ko_KR.UTF-8"));
+#else
+	logger::handle().start(PROGRAM_NAME);
+#endif
+
+	// parameter is below the information target, so it is filtered out
+	logging_level write_level
+		= filtered ? logging_level::parameter : logging_level::information;
+
+	vector<vector<long long>> latencies(producers);
+	vector<thread> threads;
+
+	auto started = chrono::steady_clock::now();
+	for (unsigned short thread_index = 0; thread_index < producers;
+		 ++thread_index)
+	{
+		threads.push_back(thread(
+			[write_level, &latencies](const unsigned short& thread_index)
+			{
+				auto& samples = latencies[thread_index];
+				samples.reserve(message_count);
+				for (unsigned int log_index = 0; log_index < message_count;
+					 ++log_index)
+				{
+					auto message = fmt::format(L"테스트_in_thread_{}: {}",
+											   thread_index, log_index);
+
+					auto begin = chrono::steady_clock::now();
+					logger::handle().write(write_level, message);
+					samples.push_back(
+						chrono::duration_cast<chrono::nanoseconds>(
+							chrono::steady_clock::now() - begin)
+							.count());
+				}
+			},
+			thread_index));
+	}
+
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+	auto produced = chrono::steady_clock::now();
+
+	logger::handle().stop();
+	auto stopped = chrono::steady_clock::now();
+
+	vector<long long> merged;
+	merged.reserve((size_t)producers * message_count);
+	for (auto& samples : latencies)
+	{
+		merged.insert(merged.end(), samples.begin(), samples.end());
+	}
+	sort(merged.begin(), merged.end());
+
+	auto percentile = [&merged](const double& rank)
+	{ return merged[(size_t)(rank * (merged.size() - 1))]; };
+
+	double seconds = chrono::duration<double>(produced - started).count();
+	report << fmt::format(
+		L"{},{},{},{},{:.0f},{},{},{},{},{},{:.3f}", style_name,
+		filtered ? L"filtered" : L"emitted", producers, merged.size(),
+		merged.size() / seconds, percentile(0.5), percentile(0.9),
+		percentile(0.99), percentile(0.999), merged.back(),
+		chrono::duration<double, milli>(stopped - produced).count())
+		   << endl;
+}
\ No newline at end of file
@@ -0,0 +1,74 @@
+#!/bin/bash
+# Trains the pgo-generate build on the echo round trip, the container
+# benchmark and the logger benchmark, then merges the profile for pgo-use.
+#
+#   cmake --preset pgo-generate && cmake --build --preset pgo-generate
+#   ./pgo_training.sh
+#   cmake --preset pgo-use && cmake --build --preset pgo-use
+
+BIN_DIR=${1:-./build/pgo/bin}
+PROFILE_DIR=${PGO_PROFILE_DIR:-./build/pgo-profile}
+ECHO_CLIENTS=${ECHO_CLIENTS:-4}
+ECHO_COUNT=${ECHO_COUNT:-5000}
+PAYLOAD_SIZE=${PAYLOAD_SIZE:-1024}
+CLIENT_TIMEOUT=${CLIENT_TIMEOUT:-300}
+SERVER_PORT=${SERVER_PORT:-9876}
+
+ECHO_SERVER="$BIN_DIR/echo_server"
+ECHO_CLIENT="$BIN_DIR/echo_client"
+CONTAINER_BENCH="$BIN_DIR/container_bench"
+LOGGING_SAMPLE="$BIN_DIR/logging_sample"
+
+if [ ! -x "$ECHO_SERVER" ] || [ ! -x "$ECHO_CLIENT" ]; then
+    echo "echo_server and echo_client were not found on $BIN_DIR, build the pgo-generate preset first"
+    exit 1
+fi
+
+mkdir -p "$PROFILE_DIR"
+export LLVM_PROFILE_FILE="$PROFILE_DIR/%p-%m.profraw"
+
+# a server only accepts the session type of its --binary_mode, so each mode
+# gets its own server and a few long-running clients
+train_echo() {
+    local port=$1 binary=$2
+
+    "$ECHO_SERVER" --server_port "$port" --logging_level 1 --binary_mode "$binary" &
+    local server_pid=$!
+    sleep 1
+
+    local client_pids=()
+    for ((client = 0; client < ECHO_CLIENTS; client++)); do
+        timeout "$CLIENT_TIMEOUT" "$ECHO_CLIENT" --server_port "$port" --logging_level 1 \
+            --binary_mode "$binary" --echo_count "$ECHO_COUNT" --payload_size "$PAYLOAD_SIZE" &
+        client_pids+=($!)
+    done
+
+    local failed=0
+    for pid in "${client_pids[@]}"; do
+        wait "$pid" || failed=$((failed + 1))
+    done
+
+    kill -TERM "$server_pid"
+    wait "$server_pid"
+
+    if [ "$failed" -gt 0 ]; then
+        echo "$failed echo_client runs failed with --binary_mode $binary, the profile is not usable"
+        exit 1
+    fi
+}
+
+train_echo "$SERVER_PORT" false
+train_echo "$((SERVER_PORT + 1))" true
+
+if [ -x "$CONTAINER_BENCH" ]; then
+    "$CONTAINER_BENCH" --benchmark_min_time=0.1 > /dev/null || exit 1
+fi
+
+if [ -x "$LOGGING_SAMPLE" ]; then
+    "$LOGGING_SAMPLE" --benchmark_mode true --producer_count 4 --message_count 10000 \
+        --benchmark_file "$PROFILE_DIR/logging_benchmark.csv" > /dev/null || exit 1
+fi
+
+if ls "$PROFILE_DIR"/*.profraw >/dev/null 2>&1; then
+    llvm-profdata merge -output="$PROFILE_DIR/default.profdata" "$PROFILE_DIR"/*.profraw
+fi
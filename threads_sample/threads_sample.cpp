@@ -70,17 +70,24 @@ void write_data(const vector<unsigned char>& data)
 
 void write_high(void)
 {
-	write_data(converter::to_array(L"테스트2_high_in_thread"));
+	static const auto data = converter::to_array(L"테스트2_high_in_thread");
+
+	write_data(data);
 }
 
 void write_normal(void)
 {
-	write_data(converter::to_array(L"테스트2_normal_in_thread"));
+	static const auto data
+		= converter::to_array(L"테스트2_normal_in_thread");
+
+	write_data(data);
 }
 
 void write_low(void)
 {
-	write_data(converter::to_array(L"테스트2_low_in_thread"));
+	static const auto data = converter::to_array(L"테스트2_low_in_thread");
+
+	write_data(data);
 }
 
 class saving_test_job : public job
@@ -109,12 +116,12 @@ public:
 protected:
 	void working(const priorities& worker_priority) override
 	{
+		static const auto data = converter::to_array(L"테스트5_in_thread");
+
 		auto pool = _job_pool.lock();
 		if (pool != nullptr)
 		{
-			pool->push(make_shared<job>(
-				priority(), converter::to_array(L"테스트5_in_thread"),
-				&write_data));
+			pool->push(make_shared<job>(priority(), data, &write_data));
 		}
 
 		switch (priority())
@@ -166,17 +173,16 @@ int main(int argc, char* argv[])
 		vector<priorities>{ priorities::high, priorities::normal }));
 
 	// unit job with callback and data
+	auto high_data = converter::to_array(L"테스트_high_in_thread");
+	auto normal_data = converter::to_array(L"테스트_normal_in_thread");
+	auto low_data = converter::to_array(L"테스트_low_in_thread");
 	for (unsigned int log_index = 0; log_index < 1000; ++log_index)
 	{
-		manager.push(make_shared<job>(
-			priorities::high, converter::to_array(L"테스트_high_in_thread"),
-			&write_data));
-		manager.push(make_shared<job>(
-			priorities::normal, converter::to_array(L"테스트_normal_in_thread"),
-			&write_data));
-		manager.push(make_shared<job>(
-			priorities::low, converter::to_array(L"테스트_low_in_thread"),
-			&write_data));
+		manager.push(
+			make_shared<job>(priorities::high, high_data, &write_data));
+		manager.push(
+			make_shared<job>(priorities::normal, normal_data, &write_data));
+		manager.push(make_shared<job>(priorities::low, low_data, &write_data));
 	}
 
 	// unit job with callback
@@ -188,15 +194,15 @@ int main(int argc, char* argv[])
 	}
 
 	// derived job with data
+	high_data = converter::to_array(L"테스트3_high_in_thread");
+	normal_data = converter::to_array(L"테스트3_normal_in_thread");
+	low_data = converter::to_array(L"테스트3_low_in_thread");
 	for (unsigned int log_index = 0; log_index < 1000; ++log_index)
 	{
-		manager.push(make_shared<saving_test_job>(
-			priorities::high, converter::to_array(L"테스트3_high_in_thread")));
-		manager.push(make_shared<saving_test_job>(
-			priorities::normal,
-			converter::to_array(L"테스트3_normal_in_thread")));
-		manager.push(make_shared<saving_test_job>(
-			priorities::low, converter::to_array(L"테스트3_low_in_thread")));
+		manager.push(make_shared<saving_test_job>(priorities::high, high_data));
+		manager.push(
+			make_shared<saving_test_job>(priorities::normal, normal_data));
+		manager.push(make_shared<saving_test_job>(priorities::low, low_data));
 	}
 
 	// derived job without data